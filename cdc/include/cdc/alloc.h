@@ -6,13 +6,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdalign.h>
+#include <stdbool.h>
 
 typedef void* (*dk_alloc_fn_t)(void* state, size_t size);
 typedef void (*dk_free_fn_t)(void* state, void* ptr);
+typedef void* (*dk_realloc_fn_t)(
+	void* state, void* ptr, size_t from, size_t to);
 
 typedef struct {
 	dk_alloc_fn_t alloc;
 	dk_free_fn_t free;
+	dk_realloc_fn_t realloc;  // Optional, falls back to alloc + copy + free
 } dk_alloc_t;
 
 typedef struct {
@@ -34,9 +38,20 @@ void dk_free(dk_alloc_t* state, void* ptr) {
 }
 
 void* dk_realloc(dk_alloc_t* state, void* ptr, size_t from, size_t to) {
+	if (state->realloc) {
+		return state->realloc(state, ptr, from, to);
+	}
+
 	void* new_ptr = dk_alloc(state, to);
 
-	memcpy(new_ptr, ptr, from);
+	if (new_ptr == NULL) {
+		return NULL;
+	}
+
+	if (ptr != NULL) {
+		memcpy(new_ptr, ptr, from < to ? from : to);
+	}
+
 	dk_free(state, ptr);
 
 	return new_ptr;
@@ -52,8 +67,17 @@ void dk_libc_free(void* s, void* ptr) {
 	free(ptr);
 }
 
+void* dk_libc_realloc(void* s, void* ptr, size_t from, size_t to) {
+	(void) s;
+	(void) from;
+	return realloc(ptr, to);
+}
+
 dk_malloc_t dk_malloc = {
-	.vtable = {.alloc = dk_libc_alloc, .free = dk_libc_free}
+	.vtable =
+		{.alloc = dk_libc_alloc,
+		 .free = dk_libc_free,
+		 .realloc = dk_libc_realloc},
 };
 
 static size_t size_align(size_t size) {
@@ -67,45 +91,161 @@ static size_t size_align(size_t size) {
 	return real_size;
 }
 
+// Arena allocator
+// Memory comes from a chain of blocks taken from `parent`. When the current
+// block runs out a new one at least twice as big is linked in front of it so
+// the number of blocks stays logarithmic in the total size. Individual frees
+// do nothing. Memory is given back in bulk with `dk_arena_release` or when
+// the arena itself is freed.
+#define DK_ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct dk_arena_block_t dk_arena_block_t;
+
+struct dk_arena_block_t {
+	dk_arena_block_t* prev;  // Older block or NULL for the first one
+	size_t size, ptr;
+	alignas(max_align_t) uint8_t data[];
+};
+
 typedef struct {
 	dk_alloc_t vtable;
 	dk_alloc_t* parent;
-	size_t size, ptr;
-	uint8_t data[];
+	dk_arena_block_t* block;  // Newest block, allocations come from here
+	void* last;               // Most recent allocation for in-place realloc
 } dk_arena_t;
 
+// Position in an arena to return to with `dk_arena_release`.
+typedef struct {
+	dk_arena_block_t* block;
+	size_t ptr;
+} dk_arena_mark_t;
+
+// The first block is allocated along with the arena itself and is only
+// given back by `dk_arena_free`.
+static dk_arena_block_t* dk_arena_first(dk_arena_t* arena) {
+	uint8_t* ptr = (uint8_t*) arena;
+	return (dk_arena_block_t*) (ptr + size_align(sizeof(dk_arena_t)));
+}
+
+static bool dk_arena_grow(dk_arena_t* arena, size_t size) {
+	size_t block_size = arena->block->size * 2;
+
+	if (block_size < size) {
+		block_size = size;
+	}
+
+	dk_arena_block_t* block =
+		dk_alloc(arena->parent, sizeof(dk_arena_block_t) + block_size);
+
+	if (block == NULL) {
+		return false;
+	}
+
+	block->prev = arena->block;
+	block->size = block_size;
+	block->ptr = 0;
+
+	arena->block = block;
+
+	return true;
+}
+
 static void* dk_arena_alloc(void* a, size_t size) {
 	dk_arena_t* arena = (dk_arena_t*) a;
 
 	size_t real_size = size_align(size);
 
-	if (arena->ptr + real_size >= arena->size) {
+	if (arena->block->ptr + real_size > arena->block->size &&
+		!dk_arena_grow(arena, real_size)) {
 		return NULL;
 	}
 
-	void* res = arena->data + arena->ptr;
-	arena->ptr += real_size;
+	void* res = arena->block->data + arena->block->ptr;
+	arena->block->ptr += real_size;
+	arena->last = res;
 
 	return res;
 }
 
+// The most recent allocation can be resized where it is as long as the
+// current block has room. Anything else is copied to a new allocation.
+static void* dk_arena_realloc(void* a, void* ptr, size_t from, size_t to) {
+	dk_arena_t* arena = (dk_arena_t*) a;
+	dk_arena_block_t* block = arena->block;
+
+	if (ptr != NULL && ptr == arena->last) {
+		size_t offset = (uint8_t*) ptr - block->data;
+
+		if (offset + size_align(to) <= block->size) {
+			block->ptr = offset + size_align(to);
+			return ptr;
+		}
+	}
+
+	void* new_ptr = dk_arena_alloc(arena, to);
+
+	if (new_ptr != NULL && ptr != NULL) {
+		memcpy(new_ptr, ptr, from < to ? from : to);
+	}
+
+	return new_ptr;
+}
+
 dk_alloc_t* dk_arena(dk_alloc_t* parent, size_t size) {
 	size_t real_size = size_align(size);
+	size_t header = size_align(sizeof(dk_arena_t));
 
-	dk_arena_t* arena = dk_alloc(parent, sizeof(dk_arena_t) + real_size);
+	dk_arena_t* arena =
+		dk_alloc(parent, header + sizeof(dk_arena_block_t) + real_size);
+
+	if (arena == NULL) {
+		return NULL;
+	}
 
 	arena->vtable.alloc = dk_arena_alloc;
 	arena->vtable.free = NULL;
+	arena->vtable.realloc = dk_arena_realloc;
 	arena->parent = parent;
-	arena->size = real_size;
-	arena->ptr = 0;
+	arena->block = dk_arena_first(arena);
+	arena->last = NULL;
+
+	arena->block->prev = NULL;
+	arena->block->size = real_size;
+	arena->block->ptr = 0;
 
 	return (dk_alloc_t*) arena;
 }
 
+dk_arena_mark_t dk_arena_mark(dk_alloc_t* a) {
+	dk_arena_t* arena = (dk_arena_t*) a;
+
+	return (dk_arena_mark_t){
+		.block = arena->block,
+		.ptr = arena->block->ptr,
+	};
+}
+
+// Free everything allocated since `mark` was taken. Only blocks chained on
+// after the mark go back to the parent, otherwise this is a single store.
+void dk_arena_release(dk_alloc_t* a, dk_arena_mark_t mark) {
+	dk_arena_t* arena = (dk_arena_t*) a;
+
+	while (arena->block != mark.block) {
+		dk_arena_block_t* prev = arena->block->prev;
+		dk_free(arena->parent, arena->block);
+		arena->block = prev;
+	}
+
+	arena->block->ptr = mark.ptr;
+	arena->last = NULL;
+}
+
 void dk_arena_free(dk_alloc_t* a) {
 	dk_arena_t* arena = (dk_arena_t*) a;
 
+	dk_arena_release(
+		a, (dk_arena_mark_t){.block = dk_arena_first(arena), .ptr = 0});
+
 	dk_free(arena->parent, arena);
 }
 
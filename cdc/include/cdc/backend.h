@@ -1,7 +1,744 @@
 #ifndef CDC_BACKEND_H
 #define CDC_BACKEND_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <sys/types.h>  // Needed for `ssize_t`
 #include <libgccjit.h>
 
+#include "def.h"
+#include "util.h"
+#include "log.h"
+#include "alloc.h"
+#include "lexer.h"
+#include "ir.h"
+#include "str.h"
+
+// Lowers the IR from `dk_parse` to libgccjit.
+//
+// Every function becomes `int64_t* f(int64_t* sp)` which takes the top of an
+// upwards growing stack and returns the new top. Inside of a function values
+// live in local variables (one per stack depth) so GCC can keep them in
+// registers. They are only written out to the stack in memory before calls
+// and on return. Popping more values than a function pushed reads them from
+// the caller's stack instead.
+//
+// The program itself is exported as `deck_main` with the same signature so
+// object files can be linked against from C.
+
+#define DK_BACKEND_ENTRY "deck_main"
+#define DK_BACKEND_APPLY "deck_apply"
+
+// Values kept in locals at once before everything is spilled to memory.
+#define DK_BACKEND_MAX_SLOTS 64
+
+// Default size of the stack used when running in memory.
+#define DK_BACKEND_STACK_SIZE (1 << 16)
+
+typedef int64_t* (*dk_entry_fn_t)(int64_t* sp);
+
+// Functions are collected up front so definitions can be referred to before
+// they appear. Quotes are numbered by their position in this table which is
+// the value pushed onto the stack for them.
+typedef struct {
+	size_t instr;  // The `[` holding the body
+	size_t name;   // Symbol naming the function or `DK_IR_NONE` for quotes
+
+	gcc_jit_function* fn;
+	gcc_jit_param* sp;
+} dk_backend_fn_t;
+
+typedef struct {
+	gcc_jit_context* jit;
+
+	gcc_jit_type* value_type;  // int64_t
+	gcc_jit_type* stack_type;  // int64_t*
+
+	dk_alloc_t* alloc;
+	dk_ir_t* ir;
+
+	dk_backend_fn_t* fns;
+	size_t fns_len;
+
+	size_t* quotes;  // Function table index by the index of its `[`
+
+	gcc_jit_function* entry;
+	gcc_jit_param* entry_sp;
+
+	gcc_jit_function* apply;  // Dispatch for `.` by quote number
+} dk_backend_t;
+
+// State while lowering the body of a single function.
+typedef struct {
+	gcc_jit_function* fn;
+	gcc_jit_block* block;
+	gcc_jit_lvalue* sp;
+
+	gcc_jit_lvalue* slots[DK_BACKEND_MAX_SLOTS];  // Created on first use
+	size_t depth;  // Number of values currently held in `slots`
+
+	size_t temps;
+	size_t blocks;
+} dk_lower_t;
+
+// Setup/teardown
+static dk_backend_t
+dk_backend_create(dk_logger_t* log, dk_alloc_t* alloc, int opt_level) {
+	DK_FUNCTION_ENTER(log);
+
+	gcc_jit_context* jit = gcc_jit_context_acquire();
+
+	if (jit == NULL) {
+		dk_log(log, DK_ERROR, "cannot create libgccjit context");
+		exit(EXIT_FAILURE);
+	}
+
+	gcc_jit_context_set_int_option(
+		jit, GCC_JIT_INT_OPTION_OPTIMIZATION_LEVEL, opt_level);
+
+	gcc_jit_type* value_type =
+		gcc_jit_context_get_int_type(jit, sizeof(int64_t), 1);
+
+	return (dk_backend_t){
+		.jit = jit,
+
+		.value_type = value_type,
+		.stack_type = gcc_jit_type_get_pointer(value_type),
+
+		.alloc = alloc,
+		.ir = NULL,
+
+		.fns = NULL,
+		.fns_len = 0,
+
+		.quotes = NULL,
+
+		.entry = NULL,
+		.entry_sp = NULL,
+
+		.apply = NULL,
+	};
+}
+
+static void dk_backend_destroy(dk_backend_t* be) {
+	dk_free(be->alloc, be->fns);
+	dk_free(be->alloc, be->quotes);
+
+	gcc_jit_context_release(be->jit);
+}
+
+static void dk_backend_check(dk_logger_t* log, dk_backend_t* be) {
+	const char* err = gcc_jit_context_get_first_error(be->jit);
+
+	if (err != NULL) {
+		dk_log(log, DK_ERROR, "libgccjit: %s", err);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Function table
+static bool dk_backend_is_definition(dk_ir_t* ir, size_t i) {
+	if (ir->kinds[i] != DK_LBRACKET) {
+		return false;
+	}
+
+	size_t end = dk_ir_end(ir, i);
+
+	return end + 2 < ir->len && ir->kinds[end + 1] == DK_SYMBOL &&
+		   ir->kinds[end + 2] == DK_DEFINE;
+}
+
+// Symbols include the leading `#` which identifiers don't.
+static const char* dk_backend_name_ptr(dk_ir_t* ir, size_t i) {
+	return ir->spans[i].ptr + (ir->kinds[i] == DK_SYMBOL);
+}
+
+static size_t dk_backend_name_len(dk_ir_t* ir, size_t i) {
+	return dk_ptrdiff(dk_backend_name_ptr(ir, i), ir->spans[i].end);
+}
+
+static bool dk_backend_name_eq(dk_ir_t* ir, size_t a, size_t b) {
+	size_t length = dk_backend_name_len(ir, a);
+
+	const char* ptr_a = dk_backend_name_ptr(ir, a);
+	const char* ptr_b = dk_backend_name_ptr(ir, b);
+
+	return length == dk_backend_name_len(ir, b) &&
+		   strncmp(ptr_a, ptr_b, length) == 0;
+}
+
+static dk_backend_fn_t* dk_backend_find(dk_backend_t* be, size_t name) {
+	for (size_t i = 0; i != be->fns_len; ++i) {
+		size_t other = be->fns[i].name;
+
+		if (other != DK_IR_NONE && dk_backend_name_eq(be->ir, other, name)) {
+			return &be->fns[i];
+		}
+	}
+
+	return NULL;
+}
+
+static gcc_jit_function* dk_backend_function(
+	dk_backend_t* be, enum gcc_jit_function_kind kind, const char* name,
+	gcc_jit_param** sp) {
+	*sp = gcc_jit_context_new_param(be->jit, NULL, be->stack_type, "sp");
+
+	return gcc_jit_context_new_function(
+		be->jit, NULL, kind, be->stack_type, name, 1, sp, 0);
+}
+
+// Nested functions are laid out inside of their parent so a single pass
+// over the IR finds all of them.
+static void dk_backend_collect(dk_logger_t* log, dk_backend_t* be) {
+	DK_FUNCTION_ENTER(log);
+
+	dk_ir_t* ir = be->ir;
+	size_t count = 0;
+
+	for (size_t i = 0; i != ir->len; ++i) {
+		count += ir->kinds[i] == DK_LBRACKET;
+	}
+
+	be->fns = dk_alloc(be->alloc, (count + 1) * sizeof(dk_backend_fn_t));
+	be->quotes = dk_alloc(be->alloc, (ir->len + 1) * sizeof(size_t));
+
+	if (be->fns == NULL || be->quotes == NULL) {
+		dk_log(log, DK_ERROR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i != ir->len; ++i) {
+		if (ir->kinds[i] != DK_LBRACKET) {
+			continue;
+		}
+
+		size_t name = dk_backend_is_definition(ir, i) ? dk_ir_end(ir, i) + 1
+													  : DK_IR_NONE;
+
+		if (name != DK_IR_NONE && dk_backend_find(be, name) != NULL) {
+			dk_log(
+				log, DK_ERROR, "redefinition of '%.*s'",
+				(int) dk_backend_name_len(ir, name),
+				dk_backend_name_ptr(ir, name));
+
+			exit(EXIT_FAILURE);
+		}
+
+		// Everything except the entry point is internal so GCC is free to
+		// inline or specialise it.
+		dk_str_t symbol = dk_str_create(be->alloc);
+
+		bool ok = name != DK_IR_NONE
+					? dk_str_appendf(
+						  &symbol, "deck_fn_%.*s",
+						  (int) dk_backend_name_len(ir, name),
+						  dk_backend_name_ptr(ir, name))
+					: dk_str_appendf(&symbol, "deck_quote_%zu", be->fns_len);
+
+		if (!ok) {
+			dk_log(log, DK_ERROR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+
+		be->quotes[i] = be->fns_len;
+		dk_backend_fn_t* fn = &be->fns[be->fns_len++];
+
+		fn->instr = i;
+		fn->name = name;
+		fn->fn = dk_backend_function(
+			be, GCC_JIT_FUNCTION_INTERNAL, dk_str_data(&symbol), &fn->sp);
+
+		dk_str_free(&symbol);
+	}
+}
+
+// Stack model
+static gcc_jit_lvalue*
+dk_lower_slot(dk_backend_t* be, dk_lower_t* lw, size_t i) {
+	if (lw->slots[i] == NULL) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "s%zu", i);
+
+		lw->slots[i] =
+			gcc_jit_function_new_local(lw->fn, NULL, be->value_type, buf);
+	}
+
+	return lw->slots[i];
+}
+
+static gcc_jit_lvalue* dk_lower_temp(dk_backend_t* be, dk_lower_t* lw) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "t%zu", lw->temps++);
+
+	return gcc_jit_function_new_local(lw->fn, NULL, be->value_type, buf);
+}
+
+static gcc_jit_block* dk_lower_block(dk_lower_t* lw) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "b%zu", lw->blocks++);
+
+	return gcc_jit_function_new_block(lw->fn, buf);
+}
+
+static gcc_jit_lvalue*
+dk_lower_sp_at(dk_backend_t* be, dk_lower_t* lw, long i) {
+	return gcc_jit_context_new_array_access(
+		be->jit, NULL, gcc_jit_lvalue_as_rvalue(lw->sp),
+		gcc_jit_context_new_rvalue_from_long(be->jit, be->value_type, i));
+}
+
+// Write every value held in locals out to memory. Needed whenever code we
+// can't see into might look at the stack.
+static void dk_lower_spill(dk_backend_t* be, dk_lower_t* lw) {
+	for (size_t i = 0; i != lw->depth; ++i) {
+		gcc_jit_block_add_assignment(
+			lw->block, NULL, dk_lower_sp_at(be, lw, (long) i),
+			gcc_jit_lvalue_as_rvalue(lw->slots[i]));
+	}
+
+	if (lw->depth > 0) {
+		gcc_jit_block_add_assignment(
+			lw->block, NULL, lw->sp,
+			gcc_jit_lvalue_get_address(
+				dk_lower_sp_at(be, lw, (long) lw->depth), NULL));
+	}
+
+	lw->depth = 0;
+}
+
+static void
+dk_lower_push(dk_backend_t* be, dk_lower_t* lw, gcc_jit_rvalue* value) {
+	if (lw->depth == DK_BACKEND_MAX_SLOTS) {
+		dk_lower_spill(be, lw);
+	}
+
+	gcc_jit_block_add_assignment(
+		lw->block, NULL, dk_lower_slot(be, lw, lw->depth), value);
+
+	lw->depth++;
+}
+
+// The result reads the slot directly so it must be used before anything
+// else is pushed in its place.
+static gcc_jit_rvalue* dk_lower_pop(dk_backend_t* be, dk_lower_t* lw) {
+	if (lw->depth > 0) {
+		return gcc_jit_lvalue_as_rvalue(lw->slots[--lw->depth]);
+	}
+
+	gcc_jit_lvalue* tmp = dk_lower_temp(be, lw);
+
+	gcc_jit_block_add_assignment(
+		lw->block, NULL, lw->sp,
+		gcc_jit_lvalue_get_address(dk_lower_sp_at(be, lw, -1), NULL));
+
+	gcc_jit_block_add_assignment(
+		lw->block, NULL, tmp,
+		gcc_jit_lvalue_as_rvalue(dk_lower_sp_at(be, lw, 0)));
+
+	return gcc_jit_lvalue_as_rvalue(tmp);
+}
+
+// Same as `dk_lower_pop` but safe to hold on to across pushes.
+static gcc_jit_rvalue* dk_lower_pop_temp(dk_backend_t* be, dk_lower_t* lw) {
+	if (lw->depth == 0) {
+		return dk_lower_pop(be, lw);
+	}
+
+	gcc_jit_lvalue* tmp = dk_lower_temp(be, lw);
+	gcc_jit_block_add_assignment(lw->block, NULL, tmp, dk_lower_pop(be, lw));
+
+	return gcc_jit_lvalue_as_rvalue(tmp);
+}
+
+static void dk_lower_call(
+	dk_backend_t* be, dk_lower_t* lw, gcc_jit_function* fn, size_t nargs,
+	gcc_jit_rvalue** extra) {
+	dk_lower_spill(be, lw);
+
+	gcc_jit_rvalue* args[2] = {gcc_jit_lvalue_as_rvalue(lw->sp)};
+
+	for (size_t i = 1; i < nargs; ++i) {
+		args[i] = extra[i - 1];
+	}
+
+	gcc_jit_block_add_assignment(
+		lw->block, NULL, lw->sp,
+		gcc_jit_context_new_call(be->jit, NULL, fn, (int) nargs, args));
+}
+
+// Lowering
+static void dk_lower_binary(
+	dk_backend_t* be, dk_lower_t* lw, enum gcc_jit_binary_op op) {
+	gcc_jit_rvalue* rhs = dk_lower_pop(be, lw);
+	gcc_jit_rvalue* lhs = dk_lower_pop(be, lw);
+
+	dk_lower_push(
+		be, lw,
+		gcc_jit_context_new_binary_op(
+			be->jit, NULL, op, be->value_type, lhs, rhs));
+}
+
+static void dk_lower_comparison(
+	dk_backend_t* be, dk_lower_t* lw, gcc_jit_rvalue* lhs,
+	enum gcc_jit_comparison op, gcc_jit_rvalue* rhs) {
+	dk_lower_push(
+		be, lw,
+		gcc_jit_context_new_cast(
+			be->jit, NULL,
+			gcc_jit_context_new_comparison(be->jit, NULL, op, lhs, rhs),
+			be->value_type));
+}
+
+// Literals are unsigned and wrap around into the signed values the program
+// works with. Anything that doesn't fit in 64 bits is rejected.
+static int64_t dk_lower_number(dk_logger_t* log, dk_ir_t* ir, size_t i) {
+	const char* begin = ir->spans[i].ptr;
+	const char* end = ir->spans[i].end;
+
+	uint64_t value = 0;
+
+	for (const char* ptr = begin; ptr != end; ++ptr) {
+		uint64_t digit = (uint64_t) (*ptr - '0');
+
+		if (value > (UINT64_MAX - digit) / 10) {
+			dk_log(
+				log, DK_ERROR, "number too large '%.*s'",
+				(int) dk_ptrdiff(begin, end), begin);
+
+			exit(EXIT_FAILURE);
+		}
+
+		value = value * 10 + digit;
+	}
+
+	return (int64_t) value;
+}
+
+// `c t f ?` keeps `t` if `c` is non-zero and `f` otherwise.
+static void dk_lower_cond(dk_backend_t* be, dk_lower_t* lw) {
+	gcc_jit_rvalue* f = dk_lower_pop(be, lw);
+	gcc_jit_rvalue* t = dk_lower_pop(be, lw);
+	gcc_jit_rvalue* c = dk_lower_pop(be, lw);
+
+	gcc_jit_lvalue* result = dk_lower_slot(be, lw, lw->depth++);
+
+	gcc_jit_block* on_true = dk_lower_block(lw);
+	gcc_jit_block* on_false = dk_lower_block(lw);
+	gcc_jit_block* after = dk_lower_block(lw);
+
+	gcc_jit_block_end_with_conditional(
+		lw->block, NULL,
+		gcc_jit_context_new_comparison(
+			be->jit, NULL, GCC_JIT_COMPARISON_NE, c,
+			gcc_jit_context_zero(be->jit, be->value_type)),
+		on_true, on_false);
+
+	gcc_jit_block_add_assignment(on_true, NULL, result, t);
+	gcc_jit_block_end_with_jump(on_true, NULL, after);
+
+	gcc_jit_block_add_assignment(on_false, NULL, result, f);
+	gcc_jit_block_end_with_jump(on_false, NULL, after);
+
+	lw->block = after;
+}
+
+// Inputs are copied out before any outputs are written since they can end up
+// in each other's slots.
+// The inputs are the identifiers between the `(` and the `->`.
+static void dk_lower_swizzle(
+	dk_logger_t* log, dk_backend_t* be, dk_lower_t* lw, size_t begin) {
+	dk_ir_t* ir = be->ir;
+	gcc_jit_rvalue* values[DK_BACKEND_MAX_SLOTS];
+
+	size_t end = dk_ir_end(ir, begin);
+	size_t arrow = begin + 1;
+
+	while (ir->kinds[arrow] != DK_ARROW) {
+		arrow++;
+	}
+
+	size_t count = arrow - (begin + 1);
+
+	if (count > DK_BACKEND_MAX_SLOTS) {
+		dk_log(log, DK_ERROR, "too many inputs to swizzle");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = count; i > 0; --i) {
+		values[i - 1] = dk_lower_pop_temp(be, lw);
+	}
+
+	for (size_t out = arrow + 1; out != end; ++out) {
+		size_t i = 0;
+
+		while (i != count && !dk_backend_name_eq(ir, begin + 1 + i, out)) {
+			i++;
+		}
+
+		if (i == count) {
+			dk_log(
+				log, DK_ERROR, "unknown swizzle slot '%.*s'",
+				(int) dk_backend_name_len(ir, out),
+				dk_backend_name_ptr(ir, out));
+
+			exit(EXIT_FAILURE);
+		}
+
+		dk_lower_push(be, lw, values[i]);
+	}
+}
+
+static void dk_lower_body(
+	dk_logger_t* log, dk_backend_t* be, gcc_jit_function* fn,
+	gcc_jit_param* sp, size_t begin, size_t end) {
+	DK_FUNCTION_ENTER(log);
+
+	dk_lower_t lw = (dk_lower_t){
+		.fn = fn,
+		.block = gcc_jit_function_new_block(fn, "entry"),
+		.sp = gcc_jit_param_as_lvalue(sp),
+
+		.slots = {NULL},
+		.depth = 0,
+
+		.temps = 0,
+		.blocks = 0,
+	};
+
+	dk_ir_t* ir = be->ir;
+
+	for (size_t i = begin; i != end; ++i) {
+		switch (ir->kinds[i]) {
+			case DK_NUMBER: {
+				long value = (long) dk_lower_number(log, ir, i);
+
+				dk_lower_push(
+					be, &lw,
+					gcc_jit_context_new_rvalue_from_long(
+						be->jit, be->value_type, value));
+			} break;
+
+			case DK_ADD: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_PLUS);
+			} break;
+
+			case DK_SUB: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_MINUS);
+			} break;
+
+			case DK_MUL: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_MULT);
+			} break;
+
+			case DK_DIV: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_DIVIDE);
+			} break;
+
+			// Truth values are always 0 or 1 so bitwise operators are enough.
+			case DK_OR: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_BITWISE_OR);
+			} break;
+
+			case DK_AND: {
+				dk_lower_binary(be, &lw, GCC_JIT_BINARY_OP_BITWISE_AND);
+			} break;
+
+			case DK_NOT: {
+				gcc_jit_rvalue* value = dk_lower_pop(be, &lw);
+
+				dk_lower_comparison(
+					be, &lw, value, GCC_JIT_COMPARISON_EQ,
+					gcc_jit_context_zero(be->jit, be->value_type));
+			} break;
+
+			case DK_EQUAL: {
+				gcc_jit_rvalue* rhs = dk_lower_pop(be, &lw);
+				gcc_jit_rvalue* lhs = dk_lower_pop(be, &lw);
+
+				dk_lower_comparison(be, &lw, lhs, GCC_JIT_COMPARISON_EQ, rhs);
+			} break;
+
+			case DK_COND: dk_lower_cond(be, &lw); break;
+
+			case DK_APPLY: {
+				gcc_jit_rvalue* quote = dk_lower_pop(be, &lw);
+				dk_lower_call(be, &lw, be->apply, 2, &quote);
+			} break;
+
+			case DK_IDENT: {
+				dk_backend_fn_t* callee = dk_backend_find(be, i);
+
+				if (callee == NULL) {
+					dk_log(
+						log, DK_ERROR, "unknown function '%.*s'",
+						(int) dk_backend_name_len(ir, i),
+						dk_backend_name_ptr(ir, i));
+
+					exit(EXIT_FAILURE);
+				}
+
+				dk_lower_call(be, &lw, callee->fn, 1, NULL);
+			} break;
+
+			// Bodies are lowered separately so we skip over them along with
+			// the name and `def` for definitions.
+			case DK_LBRACKET: {
+				bool definition = dk_backend_is_definition(ir, i);
+				long quote = (long) be->quotes[i];
+
+				i = dk_ir_end(ir, i);
+
+				if (definition) {
+					i += 2;
+					break;
+				}
+
+				dk_lower_push(
+					be, &lw,
+					gcc_jit_context_new_rvalue_from_long(
+						be->jit, be->value_type, quote));
+			} break;
+
+			case DK_LPAREN: {
+				dk_lower_swizzle(log, be, &lw, i);
+				i = dk_ir_end(ir, i);
+			} break;
+
+			default: {
+				dk_log(
+					log, DK_ERROR,
+					"'%s' is not supported by the gccjit backend",
+					DK_INSTR_TO_STR[ir->kinds[i]]);
+
+				exit(EXIT_FAILURE);
+			} break;
+		}
+	}
+
+	dk_lower_spill(be, &lw);
+	gcc_jit_block_end_with_return(
+		lw.block, NULL, gcc_jit_lvalue_as_rvalue(lw.sp));
+}
+
+// `.` jumps through a switch on the quote number. An unknown number is a
+// bug in the program so we abort.
+static void dk_backend_dispatch(dk_logger_t* log, dk_backend_t* be) {
+	DK_FUNCTION_ENTER(log);
+
+	gcc_jit_rvalue* sp =
+		gcc_jit_param_as_rvalue(gcc_jit_function_get_param(be->apply, 0));
+	gcc_jit_rvalue* quote =
+		gcc_jit_param_as_rvalue(gcc_jit_function_get_param(be->apply, 1));
+
+	gcc_jit_function* abort_fn = gcc_jit_context_new_function(
+		be->jit, NULL, GCC_JIT_FUNCTION_IMPORTED,
+		gcc_jit_context_get_type(be->jit, GCC_JIT_TYPE_VOID), "abort", 0, NULL,
+		0);
+
+	gcc_jit_block* entry = gcc_jit_function_new_block(be->apply, "entry");
+	gcc_jit_block* fail = gcc_jit_function_new_block(be->apply, "fail");
+
+	gcc_jit_block_add_eval(
+		fail, NULL, gcc_jit_context_new_call(be->jit, NULL, abort_fn, 0, NULL));
+	gcc_jit_block_end_with_return(fail, NULL, sp);
+
+	gcc_jit_case** cases =
+		dk_alloc(be->alloc, (be->fns_len + 1) * sizeof(gcc_jit_case*));
+
+	for (size_t i = 0; i != be->fns_len; ++i) {
+		gcc_jit_block* block = gcc_jit_function_new_block(be->apply, NULL);
+		gcc_jit_rvalue* n = gcc_jit_context_new_rvalue_from_long(
+			be->jit, be->value_type, (long) i);
+
+		gcc_jit_block_end_with_return(
+			block, NULL,
+			gcc_jit_context_new_call(be->jit, NULL, be->fns[i].fn, 1, &sp));
+
+		cases[i] = gcc_jit_context_new_case(be->jit, n, n, block);
+	}
+
+	gcc_jit_block_end_with_switch(
+		entry, NULL, quote, fail,
+		(int) be->fns_len, cases);
+
+	dk_free(be->alloc, cases);
+}
+
+// Build functions for every definition and quote in `ir` along with the
+// entry point which runs the top level.
+static void dk_backend_lower(dk_logger_t* log, dk_backend_t* be, dk_ir_t* ir) {
+	DK_FUNCTION_ENTER(log);
+
+	gcc_jit_param* apply_params[2] = {
+		gcc_jit_context_new_param(be->jit, NULL, be->stack_type, "sp"),
+		gcc_jit_context_new_param(be->jit, NULL, be->value_type, "quote"),
+	};
+
+	be->apply = gcc_jit_context_new_function(
+		be->jit, NULL, GCC_JIT_FUNCTION_INTERNAL, be->stack_type,
+		DK_BACKEND_APPLY, 2, apply_params, 0);
+
+	be->entry = dk_backend_function(
+		be, GCC_JIT_FUNCTION_EXPORTED, DK_BACKEND_ENTRY, &be->entry_sp);
+
+	be->ir = ir;
+	dk_backend_collect(log, be);
+
+	for (size_t i = 0; i != be->fns_len; ++i) {
+		dk_backend_fn_t* fn = &be->fns[i];
+
+		dk_lower_body(
+			log, be, fn->fn, fn->sp, fn->instr + 1, dk_ir_end(ir, fn->instr));
+	}
+
+	dk_lower_body(log, be, be->entry, be->entry_sp, 0, ir->len);
+	dk_backend_dispatch(log, be);
+
+	dk_backend_check(log, be);
+}
+
+// Outputs
+// Compile in memory and run the program on `stack` which must have room for
+// `DK_BACKEND_STACK_SIZE` values. Returns the number of values left on it.
+static size_t
+dk_backend_run(dk_logger_t* log, dk_backend_t* be, int64_t* stack) {
+	DK_FUNCTION_ENTER(log);
+
+	gcc_jit_result* result = gcc_jit_context_compile(be->jit);
+
+	if (result == NULL) {
+		dk_backend_check(log, be);
+		exit(EXIT_FAILURE);
+	}
+
+	dk_entry_fn_t entry =
+		(dk_entry_fn_t) gcc_jit_result_get_code(result, DK_BACKEND_ENTRY);
+
+	if (entry == NULL) {
+		dk_log(log, DK_ERROR, "missing entry point '%s'", DK_BACKEND_ENTRY);
+		exit(EXIT_FAILURE);
+	}
+
+	int64_t* sp = entry(stack);
+	gcc_jit_result_release(result);
+
+	return (size_t) (sp - stack);
+}
+
+static void
+dk_backend_compile(dk_logger_t* log, dk_backend_t* be, const char* path) {
+	DK_FUNCTION_ENTER(log);
+
+	gcc_jit_context_compile_to_file(
+		be->jit, GCC_JIT_OUTPUT_KIND_OBJECT_FILE, path);
+
+	dk_backend_check(log, be);
+}
+
 #endif
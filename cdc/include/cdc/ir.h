@@ -0,0 +1,107 @@
+#ifndef CDC_IR_H
+#define CDC_IR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "def.h"
+#include "util.h"
+#include "log.h"
+#include "alloc.h"
+#include "lexer.h"
+
+// Intermediate representation
+// Instructions are stored as a struct-of-arrays and addressed by index. The
+// kind of every instruction is in one array and the span of source it came
+// from is in another so passes only touch the memory they need.
+//
+// Functions (`[...]`) and swizzles (`(a b -> b a)`) keep their opening and
+// closing instructions. `ends` maps the index of an opening instruction to
+// the index of its matching close so passes can skip over a body in O(1).
+// For every other instruction the entry is unused.
+
+#define DK_IR_NONE ((size_t) -1)
+
+typedef struct {
+	const char* ptr;
+	const char* end;
+} dk_span_t;
+
+typedef struct {
+	dk_alloc_t* alloc;
+
+	dk_instr_kind_t* kinds;
+	dk_span_t* spans;
+	size_t* ends;
+
+	size_t len;
+	size_t cap;
+} dk_ir_t;
+
+static dk_ir_t dk_ir_create(dk_alloc_t* alloc) {
+	return (dk_ir_t){
+		.alloc = alloc,
+
+		.kinds = NULL,
+		.spans = NULL,
+		.ends = NULL,
+
+		.len = 0,
+		.cap = 0,
+	};
+}
+
+static void dk_ir_free(dk_ir_t* ir) {
+	dk_free(ir->alloc, ir->kinds);
+	dk_free(ir->alloc, ir->spans);
+	dk_free(ir->alloc, ir->ends);
+
+	*ir = dk_ir_create(ir->alloc);
+}
+
+static void* dk_ir_grow_array(
+	dk_logger_t* log, dk_ir_t* ir, void* ptr, size_t size, size_t cap) {
+	void* new_ptr = dk_realloc(ir->alloc, ptr, ir->len * size, cap * size);
+
+	if (new_ptr == NULL) {
+		dk_log(log, DK_ERROR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+
+	return new_ptr;
+}
+
+// Append an instruction and return its index.
+static size_t dk_ir_push(dk_logger_t* log, dk_ir_t* ir, dk_instr_t instr) {
+	if (ir->len == ir->cap) {
+		size_t cap = ir->cap == 0 ? 64 : ir->cap * 2;
+
+		ir->kinds =
+			dk_ir_grow_array(log, ir, ir->kinds, sizeof(*ir->kinds), cap);
+		ir->spans =
+			dk_ir_grow_array(log, ir, ir->spans, sizeof(*ir->spans), cap);
+		ir->ends = dk_ir_grow_array(log, ir, ir->ends, sizeof(*ir->ends), cap);
+
+		ir->cap = cap;
+	}
+
+	size_t i = ir->len++;
+
+	ir->kinds[i] = instr.kind;
+	ir->spans[i] = (dk_span_t){.ptr = instr.str.ptr, .end = instr.str.end};
+	ir->ends[i] = DK_IR_NONE;
+
+	return i;
+}
+
+// Index of the instruction closing the block opened at `i`.
+static size_t dk_ir_end(dk_ir_t* ir, size_t i) {
+	return ir->ends[i];
+}
+
+static size_t dk_ir_span_len(dk_ir_t* ir, size_t i) {
+	return dk_ptrdiff(ir->spans[i].ptr, ir->spans[i].end);
+}
+
+#endif
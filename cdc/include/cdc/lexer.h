@@ -82,9 +82,6 @@ typedef struct dk_instr_t dk_instr_t;
 struct dk_instr_t {
 	dk_instr_kind_t kind;
 
-	dk_instr_t* next;
-	dk_instr_t* prev;
-
 	union {
 		struct {
 			const char* ptr;
@@ -108,9 +105,6 @@ dk_instr_create(dk_instr_kind_t kind, const char* ptr, const char* end) {
 	return (dk_instr_t){
 		.kind = kind,
 
-		.next = NULL,
-		.prev = NULL,
-
 		.str.ptr = ptr,
 		.str.end = end,
 	};
@@ -119,37 +113,37 @@ dk_instr_create(dk_instr_kind_t kind, const char* ptr, const char* end) {
 static dk_instr_t DK_INSTR_NONE = (dk_instr_t){
 	.kind = DK_NONE,
 
-	.next = NULL,
-	.prev = NULL,
-
 	.str.ptr = NULL,
 	.str.end = NULL,
 };
 
 // Lexer
+// Maximum number of tokens that can be looked ahead at once. Must be a power
+// of two.
+#define DK_LEXER_LOOKAHEAD 4
+
 typedef struct {
 	const char* const src;
 
 	const char* ptr;
 	const char* end;
 
-	dk_instr_t peek;
+	// Ring buffer of tokens that have been lexed but not taken yet. Tokens
+	// are only lexed once no matter how many times they are peeked at.
+	dk_instr_t ring[DK_LEXER_LOOKAHEAD];
+	size_t head;   // Index of the next token to be taken
+	size_t count;  // Number of buffered tokens
 } dk_lexer_t;
 
-static bool dk_lexer_take(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr);
-
 static dk_lexer_t
 dk_lexer_create(dk_logger_t* log, const char* ptr, const char* end) {
-	dk_lexer_t lx = (dk_lexer_t){
+	return (dk_lexer_t){
 		.src = ptr,
 		.ptr = ptr,
 		.end = end,
-		.peek = dk_instr_create(DK_NONE, ptr, ptr),
+		.head = 0,
+		.count = 0,
 	};
-
-	dk_lexer_take(log, &lx, NULL);
-
-	return lx;
 }
 
 // Debugging/printing
@@ -218,7 +212,7 @@ static bool dk_take_ifc(dk_lexer_t* lx, char c) {
 static bool dk_take_str(dk_lexer_t* lx, const char* str) {
 	size_t length = strlen(str);
 
-	if (lx->ptr + length >= lx->end) {
+	if (lx->ptr + length > lx->end) {
 		return false;
 	}
 
@@ -471,18 +465,10 @@ dk_produce_comment(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
 }
 
 // Core lexer interface
-// TODO: Reconsider implementation. Is it safe to always return true?
-static bool dk_lexer_peek(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
-	if (instr != NULL) {
-		*instr = lx->peek;
-	}
-
-	return true;
-}
-
-// TODO: Make lexer_next produce all tokens and then wrap it in
+// TODO: Make lexer_produce produce all tokens and then wrap it in
 // another function which skips whitespace and comments.
-static bool dk_lexer_take(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
+static bool
+dk_lexer_produce(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
 	dk_instr_t next_instr = dk_instr_create(DK_NONE, lx->ptr, lx->ptr);
 
 	while (dk_produce_whitespace(log, lx, NULL) ||
@@ -500,19 +486,72 @@ static bool dk_lexer_take(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
 			   dk_produce_number(log, lx, &next_instr) ||
 			   dk_produce_sigil(log, lx, &next_instr)))
 	{
-		dk_log(log, DK_ERROR, "unknown character");
+		// Skip the character so the parser sees a `DK_NONE` and can report
+		// it in context.
+		next_instr.str.ptr = lx->ptr;
+		dk_take(lx);
+		next_instr.str.end = lx->ptr;
+
+		*instr = next_instr;
+
 		return false;
 	}
 
-	// Return previously peeked token and then store newly
-	// lexed token to be used on the next call to peek.
+	*instr = next_instr;
+
+	return true;
+}
+
+// Make sure at least `n + 1` tokens are buffered.
+static bool dk_lexer_fill(dk_logger_t* log, dk_lexer_t* lx, size_t n) {
+	bool ok = true;
+
+	while (lx->count <= n) {
+		size_t i = (lx->head + lx->count) & (DK_LEXER_LOOKAHEAD - 1);
+
+		ok = dk_lexer_produce(log, lx, &lx->ring[i]) && ok;
+		lx->count++;
+	}
+
+	return ok;
+}
+
+// Look at the token `n` places ahead without consuming anything. The
+// pointer is valid until the next call to `dk_lexer_take`.
+static const dk_instr_t*
+dk_lexer_peek_ref(dk_logger_t* log, dk_lexer_t* lx, size_t n) {
+	if (n >= DK_LEXER_LOOKAHEAD) {
+		dk_log(log, DK_ERROR, "lookahead of %zu is too far", n);
+		exit(EXIT_FAILURE);
+	}
+
+	dk_lexer_fill(log, lx, n);
+
+	return &lx->ring[(lx->head + n) & (DK_LEXER_LOOKAHEAD - 1)];
+}
+
+static bool dk_lexer_peek_n(
+	dk_logger_t* log, dk_lexer_t* lx, size_t n, dk_instr_t* instr) {
+	const dk_instr_t* peeked = dk_lexer_peek_ref(log, lx, n);
+
 	if (instr != NULL) {
-		dk_lexer_peek(log, lx, instr);
+		*instr = *peeked;
 	}
 
-	lx->peek = next_instr;
+	return peeked->kind != DK_NONE;
+}
 
-	return true;
+static bool dk_lexer_peek(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
+	return dk_lexer_peek_n(log, lx, 0, instr);
+}
+
+static bool dk_lexer_take(dk_logger_t* log, dk_lexer_t* lx, dk_instr_t* instr) {
+	bool ok = dk_lexer_peek(log, lx, instr);
+
+	lx->head = (lx->head + 1) & (DK_LEXER_LOOKAHEAD - 1);
+	lx->count--;
+
+	return ok;
 }
 
 #endif
@@ -3,7 +3,14 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "def.h"
 
 #define DK_RESET "\x1b[0m"
 #define DK_BOLD "\x1b[1m"
@@ -71,11 +78,55 @@ const char* DK_LOGLEVEL_COLOUR[] = {LOGLEVELS};
 
 #undef LOGLEVELS
 
+// Look up a level by its human readable name.
+static bool dk_loglevel_from_str(const char* str, dk_loglevel_t* lvl) {
+	size_t n = sizeof(DK_LOGLEVEL_HUMAN_TO_STR) / sizeof(const char*);
+
+	for (size_t i = 0; i != n; ++i) {
+		if (strcmp(DK_LOGLEVEL_HUMAN_TO_STR[i], str) == 0) {
+			*lvl = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Everything known about a logging call site at compile time. Each macro
+// below keeps one of these in static storage so an event only has to refer
+// to it.
+typedef struct {
+	dk_loglevel_t level;
+	const char* file;
+	const char* line;
+	const char* func;
+} dk_log_site_t;
+
+typedef struct {
+	uint64_t time;  // Nanoseconds
+	const dk_log_site_t* site;
+} dk_trace_record_t;
+
+#ifndef DK_TRACE_SIZE
+#define DK_TRACE_SIZE 4096
+#endif
+
+_Static_assert(
+	(DK_TRACE_SIZE & (DK_TRACE_SIZE - 1)) == 0,
+	"DK_TRACE_SIZE must be a power of 2");
+
+// Ring of the most recent events. Only the last `DK_TRACE_SIZE` are kept.
+typedef struct {
+	dk_trace_record_t records[DK_TRACE_SIZE];
+	size_t head;  // Total number of events recorded
+} dk_trace_t;
+
 typedef struct {
 	const char* name;  // Name of logger for filtering by pass or stage
 	FILE* dest;        // Destination to log to (usually stderr)
 	dk_loglevel_t level;
 	size_t indent;
+	dk_trace_t* trace;  // Events go here instead of `dest` if not NULL
 } dk_logger_t;
 
 static dk_logger_t dk_logger_create(const char* name) {
@@ -84,9 +135,14 @@ static dk_logger_t dk_logger_create(const char* name) {
 		.dest = NULL,
 		.level = DK_DEBUG,
 		.indent = 0,
+		.trace = NULL,
 	};
 }
 
+static bool dk_log_enabled(const dk_logger_t* log, dk_loglevel_t lvl) {
+	return lvl >= log->level;
+}
+
 static void dk_log_info_v(
 	dk_logger_t* log, dk_loglevel_t lvl, const char* filename, const char* line,
 	const char* func, const char* fmt, va_list args) {
@@ -154,35 +210,144 @@ static void dk_log(dk_logger_t* log, dk_loglevel_t lvl, const char* fmt, ...) {
 	va_end(args);
 }
 
-#define DK_DEBUG(log, ...) \
-	dk_log_info( \
-		log, DK_DEBUG, __FILE__, DK_STR(__LINE__), __func__, __VA_ARGS__)
+static void dk_trace_record(dk_trace_t* trace, const dk_log_site_t* site) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+
+	trace->records[trace->head++ & (DK_TRACE_SIZE - 1)] = (dk_trace_record_t){
+		.time = (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec,
+		.site = site,
+	};
+}
+
+// Only called once the level has been checked. Warnings and worse are
+// still printed when tracing since they're usually the last thing a user
+// sees before we exit.
+static void dk_log_event(
+	dk_logger_t* log, const dk_log_site_t* site, const char* fmt, ...) {
+	if (log->trace != NULL) {
+		dk_trace_record(log->trace, site);
+
+		if (site->level < DK_WARN) {
+			return;
+		}
+	}
 
-#define DK_TRACE(log, ...) \
-	dk_log_info( \
-		log, DK_TRACE, __FILE__, DK_STR(__LINE__), __func__, __VA_ARGS__)
+	va_list args;
+	va_start(args, fmt);
 
-#define DK_WARN(log, ...) \
-	dk_log_info(log, DK_WARN, __FILE__, DK_STR(__LINE__), __func__, __VA_ARGS__)
+	dk_log_info_v(
+		log, site->level, site->file, site->line, site->func, fmt, args);
 
-#define DK_ERROR(log, ...) \
-	dk_log_info( \
-		log, DK_ERROR, __FILE__, DK_STR(__LINE__), __func__, __VA_ARGS__)
+	va_end(args);
+}
 
-#define DK_OKAY(log, ...) \
-	dk_log_info(log, DK_OKAY, __FILE__, DK_STR(__LINE__), __func__, __VA_ARGS__)
+// Arguments aren't evaluated unless the level is enabled.
+#define DK_LOG_SITE(log, lvl, ...) \
+	do { \
+		static const dk_log_site_t DK_VAR(site) = { \
+			lvl, __FILE__, DK_STR(__LINE__), __func__}; \
+		if (dk_log_enabled(log, lvl)) { \
+			dk_log_event(log, &DK_VAR(site), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define DK_DEBUG(log, ...) DK_LOG_SITE(log, DK_DEBUG, __VA_ARGS__)
+#define DK_TRACE(log, ...) DK_LOG_SITE(log, DK_TRACE, __VA_ARGS__)
+#define DK_WARN(log, ...) DK_LOG_SITE(log, DK_WARN, __VA_ARGS__)
+#define DK_ERROR(log, ...) DK_LOG_SITE(log, DK_ERROR, __VA_ARGS__)
+#define DK_OKAY(log, ...) DK_LOG_SITE(log, DK_OKAY, __VA_ARGS__)
 
 // Find out where you are with a rainbow.
 #define DK_WHEREAMI(log) \
-	dk_log_info( \
-		log, DK_DEBUG, __FILE__, DK_STR(__LINE__), __func__, \
+	DK_LOG_SITE( \
+		log, DK_DEBUG, \
 		DK_FG_RED "Y" DK_FG_RED_BRIGHT "O" DK_FG_YELLOW "U" DK_RESET \
 				  " " DK_FG_GREEN "A" DK_FG_BLUE "R" DK_FG_MAGENTA \
 				  "E" DK_RESET " " DK_FG_MAGENTA_BRIGHT "H" DK_FG_RED \
 				  "E" DK_FG_RED_BRIGHT "R" DK_FG_YELLOW "E" DK_RESET)
 
-#define DK_FUNCTION_ENTER(log) \
-	dk_log_info(log, DK_DEBUG, __FILE__, DK_STR(__LINE__), __func__, NULL)
+#define DK_FUNCTION_ENTER(log) DK_LOG_SITE(log, DK_DEBUG, NULL)
+
+// Trace files start with a header, then every distinct call site that
+// appears in them and then the events oldest first. Integers are written in
+// native byte order and strings are a 32-bit length followed by the bytes.
+//
+//   header: magic[8] total:u64 sites:u32 records:u32
+//   site:   level:u32 file:str line:str func:str
+//   record: time:u64 site:u32
+#define DK_TRACE_MAGIC "dktrace1"
+
+static bool dk_trace_write_u32(FILE* fp, uint32_t x) {
+	return fwrite(&x, sizeof(x), 1, fp) == 1;
+}
+
+static bool dk_trace_write_u64(FILE* fp, uint64_t x) {
+	return fwrite(&x, sizeof(x), 1, fp) == 1;
+}
+
+static bool dk_trace_write_str(FILE* fp, const char* str) {
+	uint32_t len = str == NULL ? 0 : strlen(str);
+	return dk_trace_write_u32(fp, len) && fwrite(str, 1, len, fp) == len;
+}
+
+static size_t dk_trace_site_index(
+	const dk_log_site_t** sites, size_t n, const dk_log_site_t* site) {
+	size_t i = 0;
+
+	while (i != n && sites[i] != site) {
+		++i;
+	}
+
+	return i;
+}
+
+static bool dk_trace_write(const dk_trace_t* trace, FILE* fp) {
+	size_t first =
+		trace->head > DK_TRACE_SIZE ? trace->head - DK_TRACE_SIZE : 0;
+	size_t count = trace->head - first;
+
+	// Call sites are collected when writing rather than when recording so
+	// that recording stays as cheap as possible.
+	const dk_log_site_t** sites = malloc(sizeof(*sites) * (count + 1));
+	size_t n = 0;
+
+	if (sites == NULL) {
+		return false;
+	}
+
+	for (size_t i = first; i != trace->head; ++i) {
+		const dk_log_site_t* site =
+			trace->records[i & (DK_TRACE_SIZE - 1)].site;
+
+		if (dk_trace_site_index(sites, n, site) == n) {
+			sites[n++] = site;
+		}
+	}
+
+	bool ok = fwrite(DK_TRACE_MAGIC, 1, 8, fp) == 8 &&
+		dk_trace_write_u64(fp, trace->head) && dk_trace_write_u32(fp, n) &&
+		dk_trace_write_u32(fp, count);
+
+	for (size_t i = 0; ok && i != n; ++i) {
+		ok = dk_trace_write_u32(fp, sites[i]->level) &&
+			dk_trace_write_str(fp, sites[i]->file) &&
+			dk_trace_write_str(fp, sites[i]->line) &&
+			dk_trace_write_str(fp, sites[i]->func);
+	}
+
+	for (size_t i = first; ok && i != trace->head; ++i) {
+		const dk_trace_record_t* record =
+			&trace->records[i & (DK_TRACE_SIZE - 1)];
+
+		ok = dk_trace_write_u64(fp, record->time) &&
+			dk_trace_write_u32(fp, dk_trace_site_index(sites, n, record->site));
+	}
+
+	free(sites);
+
+	return ok;
+}
 
 // TODO: Implement "unimplemented" macro that will unconditionally abort
 // TODO: Implement "unreachable" macro
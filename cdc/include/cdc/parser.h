@@ -5,40 +5,46 @@
 #include "def.h"
 #include "util.h"
 #include "log.h"
+#include "alloc.h"
+#include "ir.h"
 
 typedef struct {
+	dk_ir_t ir;  // Instructions are appended here as they are parsed
+
 	// Function definitions
 	// Bindings
 	// Typestack
 } dk_context_t;
 
-static dk_context_t dk_context_create() {
-	return (dk_context_t){};
+static dk_context_t dk_context_create(dk_alloc_t* alloc) {
+	return (dk_context_t){
+		.ir = dk_ir_create(alloc),
+	};
 }
 
 // Primary call that sets up lexer and context automatically.
-static dk_instr_t*
-dk_parse(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
+static dk_ir_t* dk_parse(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
 
 // Forward declarations for mutual recursion
-// TODO: Make these functions return dk_instr_t* linked lists.
-static dk_instr_t*
+// These return the index of the first instruction they emit or `DK_IR_NONE`
+// if they don't emit anything.
+static size_t
 dk_parse_program(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_expression(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_function(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_builtin(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_literal(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_type(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_fntype(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_assertion(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
-static dk_instr_t*
+static size_t
 dk_parse_swizzle(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx);
 
 // Convenience functions
@@ -55,11 +61,12 @@ static bool dk_is_builtin(dk_instr_t instr) {
 
 		// Other
 		instr.kind == DK_COND || instr.kind == DK_APPLY ||
-		instr.kind == DK_EQUAL;
+		instr.kind == DK_EQUAL || instr.kind == DK_DEFINE;
 }
 
 static bool dk_is_literal(dk_instr_t instr) {
-	return instr.kind == DK_NUMBER || instr.kind == DK_STRING;
+	return instr.kind == DK_NUMBER || instr.kind == DK_STRING ||
+		   instr.kind == DK_SYMBOL;
 }
 
 static bool dk_is_primitive(dk_instr_t instr) {
@@ -78,18 +85,12 @@ static bool dk_is_expression(dk_instr_t instr) {
 // Automatically handle peeking
 static bool
 dk_peek_is_kind(dk_logger_t* log, dk_lexer_t* lx, dk_instr_kind_t kind) {
-	dk_instr_t instr;
-	dk_lexer_peek(log, lx, &instr);
-
-	return instr.kind == kind;
+	return dk_lexer_peek_ref(log, lx, 0)->kind == kind;
 }
 
 static bool
 dk_peek_is(dk_logger_t* log, dk_lexer_t* lx, dk_parser_pred_t cond) {
-	dk_instr_t instr;
-	dk_lexer_peek(log, lx, &instr);
-
-	return cond(instr);
+	return cond(*dk_lexer_peek_ref(log, lx, 0));
 }
 
 static bool dk_peek_is_expression(dk_logger_t* log, dk_lexer_t* lx) {
@@ -114,6 +115,23 @@ static bool dk_peek_is_type(dk_logger_t* log, dk_lexer_t* lx) {
 }
 
 // Parsing utilities
+
+// The lexer hands back a `DK_NONE` for characters it doesn't recognise and
+// leaves it to us to report them instead of whatever we were expecting.
+static void dk_expect_known(dk_logger_t* log, dk_lexer_t* lx) {
+	dk_instr_t instr;
+
+	if (dk_lexer_peek(log, lx, &instr)) {
+		return;
+	}
+
+	dk_log(
+		log, DK_ERROR, "unknown character '%.*s'",
+		(int) dk_ptrdiff(instr.str.ptr, instr.str.end), instr.str.ptr);
+
+	exit(EXIT_FAILURE);
+}
+
 // TODO: `dk_expect_kind` should call `dk_expect_kind` to avoid redundant code.
 static void dk_expect_kind(
 	dk_logger_t* log, dk_lexer_t* lx, dk_instr_kind_t kind, const char* fmt,
@@ -124,6 +142,8 @@ static void dk_expect_kind(
 		return;
 	}
 
+	dk_expect_known(log, lx);
+
 	dk_instr_t peeker;
 	dk_lexer_peek(log, lx, &peeker);
 
@@ -142,7 +162,7 @@ static void dk_expect_kind(
 	va_list args;
 	va_start(args, fmt);
 
-	dk_log(log, DK_ERROR, fmt, args);
+	dk_log_info_v(log, DK_ERROR, NULL, NULL, NULL, fmt, args);
 
 	va_end(args);
 
@@ -158,6 +178,8 @@ static void dk_expect(
 		return;
 	}
 
+	dk_expect_known(log, lx);
+
 	va_list args;
 	va_start(args, fmt);
 
@@ -169,28 +191,23 @@ static void dk_expect(
 }
 
 // Implementation of core parsing functions
-static dk_instr_t*
-dk_parse(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
+static dk_ir_t* dk_parse(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
-	dk_instr_t* program = dk_parse_program(log, ctx, lx);
+	dk_parse_program(log, ctx, lx);
 
-	return program;
+	return &ctx->ir;
 }
 
 // Core parsing functions
-static dk_instr_t*
+static size_t
 dk_parse_program(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
-	dk_instr_t* program =
-		NULL;  // TODO: Use allocator API to construct linked list.
+	size_t program = ctx->ir.len;
 
 	while (dk_peek_is_expression(log, lx)) {
-		// TODO: Concatenate `expr` with `program` to build up a linked list of
-		// instructions which will act as our intermediate representation in the
-		// compiler.
-		dk_instr_t* expr = dk_parse_expression(log, ctx, lx);
+		dk_parse_expression(log, ctx, lx);
 	}
 
 	dk_instr_t instr;
@@ -203,14 +220,13 @@ dk_parse_program(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	return program;
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_expression(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
 	dk_expect(log, lx, dk_is_expression, "expected an expression");
 
-	dk_instr_t* expression =
-		NULL;  // TODO: Use allocator API to construct linked list.
+	size_t expression = DK_IR_NONE;
 
 	// Integers/strings
 	if (dk_peek_is_literal(log, lx)) {
@@ -227,8 +243,8 @@ dk_parse_expression(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 		dk_instr_t instr;
 		dk_lexer_take(log, lx, &instr);
 
-		// TODO: Handle symbol reference that isn't a builtin
-		DK_WHEREAMI(log);
+		// Calls are resolved by the backend once every definition is known.
+		expression = dk_ir_push(log, &ctx->ir, instr);
 	}
 
 	// Functions
@@ -263,55 +279,56 @@ dk_parse_expression(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	return expression;
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_function(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
 	dk_expect_kind(log, lx, DK_LBRACKET, "expected '['");
-	dk_lexer_take(log, lx, NULL);
 
-	dk_instr_t* function = NULL;
+	dk_instr_t instr;
+	dk_lexer_take(log, lx, &instr);
+
+	size_t function = dk_ir_push(log, &ctx->ir, instr);
 
 	while (dk_peek_is_expression(log, lx)) {
-		// TODO: Concatenate `expr` with `function` to build up a linked list of
-		// instructions which will act as our intermediate representation in the
-		// compiler.
-		dk_instr_t* expr = dk_parse_expression(log, ctx, lx);
+		dk_parse_expression(log, ctx, lx);
 	}
 
 	dk_expect_kind(log, lx, DK_RBRACKET, "expected ']'");
-	dk_lexer_take(log, lx, NULL);
+	dk_lexer_take(log, lx, &instr);
+
+	// Pushing can move the arrays so `ends` is only read afterwards.
+	size_t end = dk_ir_push(log, &ctx->ir, instr);
+	ctx->ir.ends[function] = end;
 
 	return function;
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_builtin(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
 	dk_expect(log, lx, dk_is_builtin, "expected a built-in");
 
-	// TODO: Allocate this node on the heap and return the pointer.
 	dk_instr_t instr;
 	dk_lexer_take(log, lx, &instr);
 
-	return NULL;
+	return dk_ir_push(log, &ctx->ir, instr);
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_literal(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
 	dk_expect(log, lx, dk_is_literal, "expected a literal");
 
-	// TODO: Allocate this node on the heap and return the pointer.
 	dk_instr_t instr;
 	dk_lexer_take(log, lx, &instr);
 
-	return NULL;
+	return dk_ir_push(log, &ctx->ir, instr);
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_type(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
@@ -337,10 +354,10 @@ dk_parse_type(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 		dk_parse_fntype(log, ctx, lx);
 	}
 
-	return NULL;
+	return DK_IR_NONE;
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_fntype(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
@@ -367,10 +384,10 @@ dk_parse_fntype(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	dk_expect_kind(log, lx, DK_RPAREN, "expected ')'");
 	dk_lexer_take(log, lx, NULL);
 
-	return NULL;
+	return DK_IR_NONE;
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_assertion(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
@@ -387,48 +404,50 @@ dk_parse_assertion(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	dk_expect_kind(log, lx, DK_RPAREN, "expected ')'");
 	dk_lexer_take(log, lx, NULL);
 
-	return NULL;  // This function doesn't return anything. It just uses the
-				  // type-stack from the context to do assertions on what types
-				  // are present. We might need to do some NULL checking from
-				  // the caller level in this case.
+	return DK_IR_NONE;  // This function doesn't emit anything. It just uses
+						// the type-stack from the context to do assertions on
+						// what types are present. We might need to check for
+						// `DK_IR_NONE` from the caller level in this case.
 }
 
-static dk_instr_t*
+static size_t
 dk_parse_swizzle(dk_logger_t* log, dk_context_t* ctx, dk_lexer_t* lx) {
 	DK_FUNCTION_ENTER(log);
 
 	dk_expect_kind(log, lx, DK_LPAREN, "expected '('");
-	dk_lexer_take(log, lx, NULL);
 
-	dk_instr_t* swizzle = NULL;
+	dk_instr_t instr;
+	dk_lexer_take(log, lx, &instr);
 
-	// TODO: Collect a list of input identifiers and a list of output
-	// identifiers then match up where the old slots map to the new slots and
-	// try to synthesize a series of primitive ops that encode the same mapping.
+	// The body holds the input identifiers, the arrow and then the output
+	// identifiers. Backends match up names to find where each slot moves.
+	size_t swizzle = dk_ir_push(log, &ctx->ir, instr);
 
 	// Parse at least one identifier on the left side. This is because we can
 	// use swizzle to "drop" items from the stack where the right side is empty.
 	dk_expect_kind(log, lx, DK_IDENT, "expected an identifier");
 
 	do {
-		// TODO: Figure out what swizzle should lower to. A series of primitive
-		// dup, rot etc. or a single intrinsic.
-		dk_instr_t instr;
 		dk_lexer_take(log, lx, &instr);
+		dk_ir_push(log, &ctx->ir, instr);
 	} while (dk_peek_is_kind(log, lx, DK_IDENT));
 
 	// Seperator
 	dk_expect_kind(log, lx, DK_ARROW, "expected '->'");
-	dk_lexer_take(log, lx, NULL);
+	dk_lexer_take(log, lx, &instr);
+	dk_ir_push(log, &ctx->ir, instr);
 
 	// Parse new stack slots.
 	while (dk_peek_is_kind(log, lx, DK_IDENT)) {
-		dk_instr_t instr;
 		dk_lexer_take(log, lx, &instr);
+		dk_ir_push(log, &ctx->ir, instr);
 	}
 
 	dk_expect_kind(log, lx, DK_RPAREN, "expected ')'");
-	dk_lexer_take(log, lx, NULL);
+	dk_lexer_take(log, lx, &instr);
+
+	size_t end = dk_ir_push(log, &ctx->ir, instr);
+	ctx->ir.ends[swizzle] = end;
 
 	return swizzle;
 }
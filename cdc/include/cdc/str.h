@@ -1,51 +1,193 @@
 #ifndef CDC_STR_H
 #define CDC_STR_H
 
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "alloc.h"
-#include <string.h>
+
+// Growable string
+// Short strings are stored inline in the struct itself. Once they outgrow
+// `DK_STR_INLINE` bytes they move to memory from `alloc` and grow by half
+// their capacity each time so appends are amortised O(1). The contents are
+// always NUL terminated.
+#define DK_STR_INLINE 23
 
 typedef struct {
 	dk_alloc_t* alloc;
 	size_t len;
-	size_t cap;
-	char data[];
+	size_t cap;  // 0 while the contents are inline
+
+	union {
+		char* ptr;
+		char buf[DK_STR_INLINE + 1];
+	};
 } dk_str_t;
 
-static dk_str_t* dk_str_hdr(char* str) {
-	return (dk_str_t*) ((char*) str - sizeof(dk_str_t));
+static dk_str_t dk_str_create(dk_alloc_t* alloc) {
+	return (dk_str_t){
+		.alloc = alloc,
+		.len = 0,
+		.cap = 0,
+		.buf = {0},
+	};
+}
+
+static bool dk_str_is_inline(const dk_str_t* str) {
+	return str->cap == 0;
+}
+
+static char* dk_str_data(dk_str_t* str) {
+	return dk_str_is_inline(str) ? str->buf : str->ptr;
+}
+
+static size_t dk_str_len(const dk_str_t* str) {
+	return str->len;
+}
+
+static size_t dk_str_capacity(const dk_str_t* str) {
+	return dk_str_is_inline(str) ? DK_STR_INLINE : str->cap - 1;
+}
+
+// Make room for at least `cap` bytes (not counting the terminator).
+static bool dk_str_reserve(dk_str_t* str, size_t cap) {
+	if (cap <= dk_str_capacity(str)) {
+		return true;
+	}
+
+	size_t new_cap = dk_str_capacity(str) + dk_str_capacity(str) / 2;
+
+	if (new_cap < cap) {
+		new_cap = cap;
+	}
+
+	new_cap++;  // Terminator
+
+	char* ptr = NULL;
+
+	if (dk_str_is_inline(str)) {
+		ptr = dk_alloc(str->alloc, new_cap);
+
+		if (ptr != NULL) {
+			memcpy(ptr, str->buf, str->len + 1);
+		}
+	}
+
+	else {
+		ptr = dk_realloc(str->alloc, str->ptr, str->cap, new_cap);
+	}
+
+	if (ptr == NULL) {
+		return false;
+	}
+
+	str->ptr = ptr;
+	str->cap = new_cap;
+
+	return true;
+}
+
+// `ptr` may point into `str` itself. Growing moves the contents so we hold
+// on to its offset instead and find it again afterwards.
+static bool dk_str_append_n(dk_str_t* str, const char* ptr, size_t len) {
+	const char* old = dk_str_data(str);
+	bool inside = ptr >= old && ptr < old + str->len;
+	size_t offset = inside ? (size_t) (ptr - old) : 0;
+
+	if (!dk_str_reserve(str, str->len + len)) {
+		return false;
+	}
+
+	char* data = dk_str_data(str);
+
+	if (inside) {
+		ptr = data + offset;
+	}
+
+	memcpy(data + str->len, ptr, len);
+	str->len += len;
+	data[str->len] = '\0';
+
+	return true;
+}
+
+static bool dk_str_append_cstr(dk_str_t* str, const char* cstr) {
+	return dk_str_append_n(str, cstr, strlen(cstr));
+}
+
+static bool dk_str_append_char(dk_str_t* str, char c) {
+	return dk_str_append_n(str, &c, 1);
 }
 
-static char* dk_str(dk_alloc_t* alloc, const char* str) {
-	size_t len = strlen(str);
-	size_t cap = len + 1;
-	dk_str_t* tmp = dk_alloc(alloc, sizeof(dk_str_t) + cap);
+static bool dk_str_append(dk_str_t* to, dk_str_t* from) {
+	return dk_str_append_n(to, dk_str_data(from), dk_str_len(from));
+}
+
+// Formats straight into the spare capacity and only grows and formats a
+// second time if that wasn't enough.
+static bool dk_str_appendf_v(dk_str_t* str, const char* fmt, va_list args) {
+	va_list retry;
+	va_copy(retry, args);
+
+	size_t spare = dk_str_capacity(str) - str->len + 1;
+	int n = vsnprintf(dk_str_data(str) + str->len, spare, fmt, args);
+
+	// Anything the first attempt wrote has to go if we give up.
+	if (n < 0) {
+		dk_str_data(str)[str->len] = '\0';
+		va_end(retry);
+		return false;
+	}
+
+	if ((size_t) n >= spare) {
+		if (!dk_str_reserve(str, str->len + n)) {
+			dk_str_data(str)[str->len] = '\0';
+			va_end(retry);
+			return false;
+		}
+
+		vsnprintf(dk_str_data(str) + str->len, n + 1, fmt, retry);
+	}
 
-	tmp->alloc = alloc;
-	tmp->len = len;
-	tmp->cap = cap;
+	va_end(retry);
+	str->len += n;
 
-	return tmp->data;
+	return true;
 }
 
-static void dk_str_free(char* str) {
-	dk_str_t* str_hdr = dk_str_hdr(str);
-	dk_free(str_hdr->alloc, str_hdr);
+static bool dk_str_appendf(dk_str_t* str, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+
+	bool ok = dk_str_appendf_v(str, fmt, args);
+
+	va_end(args);
+
+	return ok;
 }
 
-static char* dk_str_append(char* to, char* from) {
-	dk_str_t* to_hdr = dk_str_hdr(to);
-	dk_str_t* from_hdr = dk_str_hdr(from);
+static dk_str_t dk_str(dk_alloc_t* alloc, const char* cstr) {
+	dk_str_t str = dk_str_create(alloc);
+	dk_str_append_cstr(&str, cstr);
 
-	size_t new_len = to_hdr->len + from_hdr->len;
-	size_t new_cap = to_hdr->cap;
+	return str;
+}
+
+// Keeps the capacity around for reuse.
+static void dk_str_clear(dk_str_t* str) {
+	str->len = 0;
+	dk_str_data(str)[0] = '\0';
+}
 
-	if (new_len + 1 >= to_hdr->cap) {
-		new_cap = (new_len / 2) * 3;
+static void dk_str_free(dk_str_t* str) {
+	if (!dk_str_is_inline(str)) {
+		dk_free(str->alloc, str->ptr);
 	}
 
-	return NULL;
+	*str = dk_str_create(str->alloc);
 }
 
 #endif
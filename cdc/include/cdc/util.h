@@ -40,24 +40,34 @@ static dk_err_t dk_read_stdin(char** buffer, size_t* length) {
 	size_t capacity = 256;
 	size_t index = 0;
 
+	if (!buf) {
+		return errno;
+	}
+
 	int c;
 	while ((c = fgetc(stdin)) != EOF) {
-		// if (index >= capacity) {
-		// 	capacity *= 2;
-		// 	*buffer = realloc(*buffer, capacity);
+		if (index >= capacity) {
+			capacity *= 2;
+			char* grown = realloc(buf, capacity);
+
+			if (!grown) {
+				free(buf);
+				return errno;
+			}
 
-		// 	if (!*buffer) {
-		// 		return errno;
-		// 	}
-		// }
+			buf = grown;
+		}
 
 		buf[index++] = c;
 	}
 
 	if (ferror(stdin)) {
-		return errno;
+		dk_err_t code = errno;
+		free(buf);
+		return code;
 	}
 
+	*buffer = buf;
 	*length = index;
 
 	return 0;
@@ -1,94 +1,136 @@
+#include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// #include <cdc/alloc.h>
+#include <cdc/alloc.h>
 #include <cdc/backend.h>
 #include <cdc/def.h>
+#include <cdc/ir.h>
 #include <cdc/lexer.h>
 #include <cdc/parser.h>
 #include <cdc/util.h>
 #include <cdc/str.h>
 #include <cdc/log.h>
 
+// Written out on every exit, including after a fatal error.
+static dk_trace_t trace;
+static const char* trace_path = NULL;
+
+static void dk_trace_flush(void) {
+	FILE* fp = fopen(trace_path, "wb");
+
+	if (fp == NULL || !dk_trace_write(&trace, fp)) {
+		fprintf(stderr, "error: '%s': %s\n", trace_path, strerror(errno));
+	}
+
+	if (fp != NULL) {
+		fclose(fp);
+	}
+}
+
 int main(int argc, char* argv[]) {
-	// int opt = 0;
-	// char buf[256];
-
-	// while ((opt = getopt(argc, argv, "i:")) != -1) {
-	// 	switch (opt) {
-	// 		case 'i': {
-	// 			strncpy(buf, optarg, 256 - 1);
-	// 			fprintf(stderr, "path: %s\n", buf);
-	// 		} break;
-
-	// 		default: {
-	// 			if (!dk_basename(argv[0], buf, 256)) {
-	// 				fprintf(stderr, "usage: %s -i [FILE]\n", buf);
-	// 			}
-	// 			return 1;
-	// 		} break;
-	// 	}
-	// }
-
-	// char* src;
-	// size_t len;
-	// dk_err_t err;
-
-	// if (!buf[0]) {
-	// 	err = dk_read_stdin(&src, &len);
-	// 	if (err) {
-	// 		fprintf(stderr, "error: <stdin>: %s\n", strerror(err));
-	// 		return 1;
-	// 	}
-	// }
-	// else {
-	// 	err = dk_read_file(buf, &src, &len);
-	// 	if (err) {
-	// 		fprintf(stderr, "error: '%s': %s\n", buf, strerror(err));
-	// 		return 1;
-	// 	}
-	// }
-
-	// dk_lexer_t lx = dk_lexer_create(src, len);
-
-	// token_t tok;
-	// while (lexer_next(&lx, &tok) && tok.kind != TOK_EOF) {
-	// 	printf("tok: %s : %d\n", tok_to_str[tok.kind], (int) lx.src[tok.start]);
-	// }
-
-	// free(src);
-
-	// char* str;
-	// size_t length;
-
-	// dk_err_t err;
-
-	// if ((err = dk_read_stdin(&str, &length))) {
-	// 	fprintf(stderr, "error: <stdin>: %s\n", strerror(err));
-	// 	return 1;
-	// }
-
-	// const char* str =
-	// 	"f ba baz     \n FUCKER  #! sdofhsodfhoisdfhio\n          fuck";
-
-	// dk_instr_t instr;
-	// dk_lexer_t lx = dk_lexer_create(str, str + strlen(str));
-
-	// while (dk_lexer_take(&lx, &instr) && instr.kind != DK_ENDFILE) {
-	// 	dk_instr_print(&lx, instr);
-	// }
-
-	const char* input = "123 +123";
+	int opt = 0;
+
+	const char* input = NULL;   // Read from stdin if not given
+	const char* output = NULL;  // Run in memory if not given
+	int level = 2;
+	dk_loglevel_t verbosity = DK_DEBUG;
+
+	while ((opt = getopt(argc, argv, "i:o:O:l:t:")) != -1) {
+		switch (opt) {
+			case 'i': input = optarg; break;
+			case 'o': output = optarg; break;
+			case 'O': level = atoi(optarg); break;
+			case 't': trace_path = optarg; break;
+
+			case 'l': {
+				if (!dk_loglevel_from_str(optarg, &verbosity)) {
+					fprintf(stderr, "error: unknown log level '%s'\n", optarg);
+					return 1;
+				}
+			} break;
+
+			default: {
+				fprintf(
+					stderr,
+					"usage: %s [-i FILE] [-o OBJECT] [-O LEVEL] [-l LOGLEVEL] "
+					"[-t TRACE]\n",
+					dk_exe(argv[0]));
+				return 1;
+			} break;
+		}
+	}
+
+	char* src = NULL;
+	size_t len = 0;
+	dk_err_t err;
+
+	if (input == NULL) {
+		err = dk_read_stdin(&src, &len);
+		if (err) {
+			fprintf(stderr, "error: <stdin>: %s\n", strerror(err));
+			return 1;
+		}
+	}
+
+	else {
+		err = dk_read_file(input, &src, &len);
+		if (err) {
+			fprintf(stderr, "error: '%s': %s\n", input, strerror(err));
+			return 1;
+		}
+	}
 
 	dk_logger_t log = dk_logger_create("global");
-	dk_context_t ctx = dk_context_create();
-	dk_lexer_t lx = dk_lexer_create(&log, input, input + strlen(input));
+	log.level = verbosity;
+
+	if (trace_path != NULL) {
+		log.trace = &trace;
+		atexit(dk_trace_flush);
+	}
+
+	dk_alloc_t* arena = dk_arena(&dk_malloc.vtable, DK_ARENA_BLOCK_SIZE);
+
+	// The IR grows by doubling so libc realloc, which can move pages
+	// instead of copying, beats the arena here.
+	dk_context_t ctx = dk_context_create(&dk_malloc.vtable);
+	dk_lexer_t lx = dk_lexer_create(&log, src, src + len);
+
+	dk_ir_t* ir = dk_parse(&log, &ctx, &lx);
+
+	dk_backend_t be = dk_backend_create(&log, arena, level);
+	dk_backend_lower(&log, &be, ir);
+
+	if (output != NULL) {
+		dk_backend_compile(&log, &be, output);
+	}
+
+	else {
+		dk_arena_mark_t mark = dk_arena_mark(arena);
+
+		size_t size = DK_BACKEND_STACK_SIZE * sizeof(int64_t);
+		int64_t* stack = dk_alloc(arena, size);
+
+		size_t depth = dk_backend_run(&log, &be, stack);
+
+		for (size_t i = 0; i != depth; ++i) {
+			printf("%" PRId64 "\n", stack[i]);
+		}
+
+		dk_arena_release(arena, mark);
+	}
+
+	dk_backend_destroy(&be);
+	dk_ir_free(ir);
+	dk_arena_free(arena);
 
-	dk_parse(&log, &ctx, &lx);
+	free(src);
 
 	return 0;
 }
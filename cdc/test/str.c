@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cdc/alloc.h>
+#include <cdc/str.h>
+
+// Checks for the string builder in `include/cdc/str.h`.
+
+static int dk_failures = 0;
+
+#define DK_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#cond); \
+			dk_failures++; \
+		} \
+	} while (0)
+
+static void* dk_null_alloc(void* s, size_t size) {
+	return NULL;
+}
+
+// Appending a string to itself has to survive the contents moving, both
+// out of the inline buffer and to a bigger heap block.
+static void dk_test_self_append(void) {
+	dk_str_t inline_str = dk_str(&dk_malloc.vtable, "0123456789abcdef");
+	dk_str_append(&inline_str, &inline_str);
+
+	DK_CHECK(dk_str_len(&inline_str) == 32);
+	DK_CHECK(
+		strcmp(
+			dk_str_data(&inline_str),
+			"0123456789abcdef0123456789abcdef") == 0);
+
+	dk_str_t heap_str =
+		dk_str(&dk_malloc.vtable, "0123456789abcdefghijklmnopqrstuvwxyz");
+	dk_str_append(&heap_str, &heap_str);
+
+	DK_CHECK(dk_str_len(&heap_str) == 72);
+	DK_CHECK(
+		memcmp(
+			dk_str_data(&heap_str),
+			"0123456789abcdefghijklmnopqrstuvwxyz"
+			"0123456789abcdefghijklmnopqrstuvwxyz",
+			73) == 0);
+
+	dk_str_append_n(&heap_str, dk_str_data(&heap_str) + 68, 4);
+
+	DK_CHECK(dk_str_len(&heap_str) == 76);
+	DK_CHECK(memcmp(dk_str_data(&heap_str) + 68, "wxyzwxyz", 9) == 0);
+
+	dk_str_free(&inline_str);
+	dk_str_free(&heap_str);
+}
+
+// A failed append leaves the string as it was.
+static void dk_test_appendf_failure(void) {
+	dk_alloc_t none = {.alloc = dk_null_alloc};
+	dk_str_t str = dk_str(&none, "abc");
+
+	DK_CHECK(
+		!dk_str_appendf(&str, "%s", "0123456789abcdefghijklmnopqrstuvwxyz"));
+	DK_CHECK(dk_str_len(&str) == 3);
+	DK_CHECK(strcmp(dk_str_data(&str), "abc") == 0);
+}
+
+int main(void) {
+	dk_test_self_append();
+	dk_test_appendf_failure();
+
+	return dk_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,195 @@
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cdc/util.h>
+#include <cdc/log.h>
+
+// Decoder for the trace files written by `cdc -t`. See `dk_trace_write` in
+// `include/cdc/log.h` for the format.
+
+typedef struct {
+	uint32_t level;
+	char* file;
+	char* line;
+	char* func;
+	size_t hits;
+} dk_trace_site_t;
+
+static bool dk_trace_read_u32(FILE* fp, uint32_t* x) {
+	return fread(x, sizeof(*x), 1, fp) == 1;
+}
+
+static bool dk_trace_read_u64(FILE* fp, uint64_t* x) {
+	return fread(x, sizeof(*x), 1, fp) == 1;
+}
+
+// `size` is the size of the whole file. A corrupt length can't ask for more
+// than is left in it.
+static bool dk_trace_read_str(FILE* fp, long size, char** str) {
+	uint32_t len = 0;
+
+	if (!dk_trace_read_u32(fp, &len)) {
+		return false;
+	}
+
+	long pos = ftell(fp);
+
+	if (pos < 0 || (uint64_t) len > (uint64_t) (size - pos)) {
+		return false;
+	}
+
+	if ((*str = malloc((size_t) len + 1)) == NULL) {
+		return false;
+	}
+
+	(*str)[len] = '\0';
+	return fread(*str, 1, len, fp) == len;
+}
+
+static void dk_trace_die(const char* path, const char* what) {
+	fprintf(stderr, "error: '%s': %s\n", path, what);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+	int opt = 0;
+	bool summary = false;
+
+	while ((opt = getopt(argc, argv, "s")) != -1) {
+		switch (opt) {
+			case 's': summary = true; break;
+
+			default: {
+				fprintf(stderr, "usage: %s [-s] TRACE\n", dk_exe(argv[0]));
+				return 1;
+			} break;
+		}
+	}
+
+	if (optind + 1 != argc) {
+		fprintf(stderr, "usage: %s [-s] TRACE\n", dk_exe(argv[0]));
+		return 1;
+	}
+
+	const char* path = argv[optind];
+	FILE* fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		dk_trace_die(path, strerror(errno));
+	}
+
+	long size = -1;
+
+	if (fseek(fp, 0, SEEK_END) == 0) {
+		size = ftell(fp);
+		rewind(fp);
+	}
+
+	if (size < 0) {
+		dk_trace_die(path, strerror(errno));
+	}
+
+	char magic[8];
+	uint64_t total = 0;
+	uint32_t n_sites = 0;
+	uint32_t n_records = 0;
+
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+		memcmp(magic, DK_TRACE_MAGIC, sizeof(magic)) != 0) {
+		dk_trace_die(path, "not a cdc trace");
+	}
+
+	if (!dk_trace_read_u64(fp, &total) || !dk_trace_read_u32(fp, &n_sites) ||
+		!dk_trace_read_u32(fp, &n_records)) {
+		dk_trace_die(path, "truncated header");
+	}
+
+	// Each call site takes at least its level and the lengths of its three
+	// strings so a corrupt count can't make us allocate more than that.
+	if ((uint64_t) n_sites * 4 * sizeof(uint32_t) >
+		(uint64_t) (size - ftell(fp))) {
+		dk_trace_die(path, "truncated call site");
+	}
+
+	dk_trace_site_t* sites = calloc((size_t) n_sites + 1, sizeof(*sites));
+
+	if (sites == NULL) {
+		dk_trace_die(path, "out of memory");
+	}
+
+	for (uint32_t i = 0; i != n_sites; ++i) {
+		dk_trace_site_t* site = &sites[i];
+
+		if (!dk_trace_read_u32(fp, &site->level) ||
+			!dk_trace_read_str(fp, size, &site->file) ||
+			!dk_trace_read_str(fp, size, &site->line) ||
+			!dk_trace_read_str(fp, size, &site->func)) {
+			dk_trace_die(path, "truncated call site");
+		}
+
+		if (site->level > DK_OKAY) {
+			dk_trace_die(path, "invalid log level");
+		}
+	}
+
+	printf("%" PRIu32 " of %" PRIu64 " events\n", n_records, total);
+
+	uint64_t start = 0;
+
+	for (uint32_t i = 0; i != n_records; ++i) {
+		uint64_t time = 0;
+		uint32_t index = 0;
+
+		if (!dk_trace_read_u64(fp, &time) || !dk_trace_read_u32(fp, &index)) {
+			dk_trace_die(path, "truncated event");
+		}
+
+		if (index >= n_sites) {
+			dk_trace_die(path, "event refers to an unknown call site");
+		}
+
+		dk_trace_site_t* site = &sites[index];
+		site->hits++;
+
+		if (i == 0) {
+			start = time;
+		}
+
+		if (summary) {
+			continue;
+		}
+
+		printf(
+			"%12.3fus %s [%s:%s] `%s`\n", (double) (time - start) / 1000.0,
+			DK_LOGLEVEL_TO_STR[site->level], site->file, site->line,
+			site->func);
+	}
+
+	if (summary) {
+		for (uint32_t i = 0; i != n_sites; ++i) {
+			dk_trace_site_t* site = &sites[i];
+
+			printf(
+				"%10zu %s [%s:%s] `%s`\n", site->hits,
+				DK_LOGLEVEL_TO_STR[site->level], site->file, site->line,
+				site->func);
+		}
+	}
+
+	for (uint32_t i = 0; i != n_sites; ++i) {
+		free(sites[i].file);
+		free(sites[i].line);
+		free(sites[i].func);
+	}
+
+	free(sites);
+	fclose(fp);
+
+	return 0;
+}
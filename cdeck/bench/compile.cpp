@@ -0,0 +1,485 @@
+// Measure how long each stage of the compiler takes, how much memory it
+// needs and how fast the executable it produces runs. Results are written
+// as JSON so runs can be compared against each other.
+// Usage: deck-bench [-o results.json] [-r runs] [-s bytes] [file...]
+// Without files, every workload in `bench/workloads` is measured along with
+// a few generated sources of `-s` bytes (4 MiB by default).
+
+#include <utility>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <deck/deck.hpp>
+
+#include <deck/passes/fold.hpp>
+#include <deck/passes/effects.hpp>
+#include <deck/passes/inline.hpp>
+#include <deck/passes/x86-64.hpp>
+#include <deck/passes/peephole.hpp>
+#include <deck/passes/elf.hpp>
+
+using namespace deck;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Sources are loaded one at a time so the generated ones don't all
+	// count towards the peak memory of every measurement.
+	struct Workload {
+		std::string name;
+		std::function<Source()> load;
+	};
+
+	// Written by the child that compiles a workload. Times are in
+	// milliseconds.
+	struct Compile {
+		bool ok = false;
+
+		size_t symbols = 0;
+		size_t instructions = 0;
+
+		double lex = 0.0;
+		double parse = 0.0;
+		double passes = 0.0;
+		double lower = 0.0;
+		double emit = 0.0;
+	};
+
+	struct Result {
+		std::string name;
+		size_t bytes = 0;
+
+		Compile compile;
+		long compile_rss = 0;  // KiB
+
+		std::vector<double> runs;
+		long run_rss = 0;  // KiB
+		int status = 0;
+	};
+
+	double since(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Generators
+	std::string straight_line(size_t bytes) {
+		std::string src = "0 ";
+
+		while (src.size() < bytes) {
+			src += "1 2 + dup * pop 3 4 5 ? + 7 dup - pop\n";
+		}
+
+		return src;
+	}
+
+	std::string many_labels(size_t bytes) {
+		std::string calls = "0 ";
+		std::string labels;
+
+		for (size_t i = 0; calls.size() + labels.size() < bytes; ++i) {
+			std::string name = "word_" + std::to_string(i);
+
+			calls += name + " ";
+			labels += "$def " + name + " 1 " + std::to_string(i) + " * pop .\n";
+		}
+
+		return calls + "&end .\n" + labels + "$def end\n";
+	}
+
+	std::string nested_blocks(size_t bytes) {
+		std::string src = "0 ";
+
+		while (src.size() < bytes) {
+			src += "[ 1 [ 2 3 + pop ] { 4 5 * pop . } pop pop ] [ # pop ]\n";
+		}
+
+		return src;
+	}
+
+	Workload file_workload(std::filesystem::path path) {
+		return { path.stem().string(), [=] { return map_source(path.c_str()); } };
+	}
+
+	std::vector<Workload> default_workloads(size_t size) {
+		std::vector<Workload> workloads;
+
+		std::filesystem::path dir = DECK_BENCH_WORKLOADS;
+		std::vector<std::filesystem::path> paths;
+
+		for (const auto& entry: std::filesystem::directory_iterator { dir }) {
+			if (entry.path().extension() == ".dk") {
+				paths.push_back(entry.path());
+			}
+		}
+
+		std::sort(paths.begin(), paths.end());
+
+		for (const auto& path: paths) {
+			workloads.push_back(file_workload(path));
+		}
+
+		workloads.push_back({ "gen-straight-line", [=] { return make_source(straight_line(size)); } });
+		workloads.push_back({ "gen-many-labels", [=] { return make_source(many_labels(size)); } });
+		workloads.push_back({ "gen-nested-blocks", [=] { return make_source(nested_blocks(size)); } });
+
+		return workloads;
+	}
+
+	// Compile the same way `deck` does minus the debug passes.
+	Compile compile(const Source& src, const std::string& output) {
+		Compile result;
+		auto start = Clock::now();
+
+		{
+			Interner interner;
+			Lexer lx { src.view, interner };
+
+			while (lx.peek.kind != SymbolKind::Terminator) {
+				[[maybe_unused]] Symbol sym = lx.take();
+			}
+		}
+
+		result.lex = since(start);
+		start = Clock::now();
+
+		Tree tree = parse(src);
+		result.symbols = tree.size();
+
+		result.parse = since(start);
+		start = Clock::now();
+
+		tree = passes::fold(std::move(tree));
+		tree = passes::effects(std::move(tree));
+		tree = passes::inliner(std::move(tree));
+
+		result.passes = since(start);
+		start = Clock::now();
+
+		x86::Program program = passes::x86_64(std::move(tree));
+		program = passes::peephole(std::move(program));
+		result.instructions = program.instructions.size();
+
+		result.lower = since(start);
+		start = Clock::now();
+
+		program = passes::elf(std::move(program), output.c_str());
+
+		result.emit = since(start);
+		result.ok = true;
+
+		return result;
+	}
+
+	// Compile in a child so its peak RSS isn't mixed up with other
+	// workloads or the generators.
+	Compile measure_compile(const Source& src, const std::string& output, long& rss) {
+		int fds[2];
+
+		if (::pipe(fds) == -1) {
+			fatal("cannot create pipe: ", std::strerror(errno));
+		}
+
+		pid_t pid = ::fork();
+
+		if (pid == -1) {
+			fatal("cannot fork: ", std::strerror(errno));
+		}
+
+		if (pid == 0) {
+			::close(fds[0]);
+
+			// Logging goes to stderr and would dominate the timings.
+			std::cerr.setstate(std::ios::badbit);
+
+			Compile result;
+
+			try {
+				result = compile(src, output);
+			}
+
+			catch (const Exception&) {
+			}
+
+			[[maybe_unused]] ssize_t n = ::write(fds[1], &result, sizeof(result));
+			::_exit(0);
+		}
+
+		::close(fds[1]);
+
+		Compile result;
+
+		if (::read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+			result.ok = false;
+		}
+
+		::close(fds[0]);
+
+		int status = 0;
+		struct rusage usage {};
+
+		::wait4(pid, &status, 0, &usage);
+		rss = usage.ru_maxrss;
+
+		return result;
+	}
+
+	// Run the executable with its output discarded.
+	void run_once(const char* path, long& rss, int& status, double& elapsed) {
+		auto start = Clock::now();
+		pid_t pid = ::fork();
+
+		if (pid == -1) {
+			fatal("cannot fork: ", std::strerror(errno));
+		}
+
+		if (pid == 0) {
+			int null = ::open("/dev/null", O_WRONLY);
+			::dup2(null, STDOUT_FILENO);
+
+			::execl(path, path, nullptr);
+			::_exit(127);
+		}
+
+		int wstatus = 0;
+		struct rusage usage {};
+
+		::wait4(pid, &wstatus, 0, &usage);
+		elapsed = since(start);
+
+		rss = usage.ru_maxrss;
+		status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+	}
+
+	// A forked child starts out with every page of its parent mapped and
+	// `ru_maxrss` counts those even after `exec`. Runs are made from a
+	// fresh copy of this program (`deck-bench --run path n`) so the peak
+	// RSS we report is close to that of the executable itself.
+	void measure_runs(const std::string& path, size_t runs, Result& result) {
+		int fds[2];
+
+		if (::pipe(fds) == -1) {
+			fatal("cannot create pipe: ", std::strerror(errno));
+		}
+
+		pid_t pid = ::fork();
+
+		if (pid == -1) {
+			fatal("cannot fork: ", std::strerror(errno));
+		}
+
+		if (pid == 0) {
+			::close(fds[0]);
+			::dup2(fds[1], STDOUT_FILENO);
+
+			std::string n = std::to_string(runs);
+
+			::execl("/proc/self/exe", "deck-bench", "--run", path.c_str(), n.c_str(), nullptr);
+			::_exit(127);
+		}
+
+		::close(fds[1]);
+
+		std::string out;
+		char buf[4096];
+
+		for (ssize_t n = 0; (n = ::read(fds[0], buf, sizeof(buf))) > 0;) {
+			out.append(buf, n);
+		}
+
+		::close(fds[0]);
+		::waitpid(pid, nullptr, 0);
+
+		std::istringstream ss { out };
+		double elapsed = 0.0;
+		long rss = 0;
+
+		while (ss >> elapsed >> rss >> result.status) {
+			result.runs.push_back(elapsed);
+			result.run_rss = std::max(result.run_rss, rss);
+		}
+	}
+
+	double median(std::vector<double> xs) {
+		if (xs.empty()) {
+			return 0.0;
+		}
+
+		std::sort(xs.begin(), xs.end());
+		return xs[xs.size() / 2];
+	}
+
+	std::string json_string(std::string_view str) {
+		std::string out = "\"";
+
+		for (char c: str) {
+			if (c == '"' or c == '\\') {
+				out += '\\';
+			}
+
+			out += c;
+		}
+
+		return out + "\"";
+	}
+
+	void write_json(std::ostream& os, const std::vector<Result>& results) {
+		println(os, "[");
+
+		for (size_t i = 0; i != results.size(); ++i) {
+			const Result& r = results[i];
+			const Compile& c = r.compile;
+
+			println(os, "\t{");
+			println(os, "\t\t\"name\": ", json_string(r.name), ",");
+			println(os, "\t\t\"bytes\": ", r.bytes, ",");
+			println(os, "\t\t\"compiled\": ", c.ok ? "true" : "false", ",");
+			println(os, "\t\t\"symbols\": ", c.symbols, ",");
+			println(os, "\t\t\"instructions\": ", c.instructions, ",");
+			println(os, "\t\t\"lex_ms\": ", c.lex, ",");
+			println(os, "\t\t\"parse_ms\": ", c.parse, ",");
+			println(os, "\t\t\"passes_ms\": ", c.passes, ",");
+			println(os, "\t\t\"lower_ms\": ", c.lower, ",");
+			println(os, "\t\t\"emit_ms\": ", c.emit, ",");
+			println(os, "\t\t\"compile_rss_kib\": ", r.compile_rss, ",");
+			println(os, "\t\t\"runs\": ", r.runs.size(), ",");
+			println(os, "\t\t\"run_median_ms\": ", median(r.runs), ",");
+			println(os, "\t\t\"run_min_ms\": ", r.runs.empty() ? 0.0 : *std::min_element(r.runs.begin(), r.runs.end()), ",");
+			println(os, "\t\t\"run_rss_kib\": ", r.run_rss, ",");
+			println(os, "\t\t\"status\": ", r.status);
+			println(os, "\t}", i + 1 == results.size() ? "" : ",");
+		}
+
+		println(os, "]");
+	}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+	try {
+		// See `measure_runs`.
+		if (argc == 4 and std::string_view { argv[1] } == "--run") {
+			size_t runs = std::strtoul(argv[3], nullptr, 10);
+
+			for (size_t i = 0; i != runs; ++i) {
+				long rss = 0;
+				int status = 0;
+				double elapsed = 0.0;
+
+				run_once(argv[2], rss, status, elapsed);
+				println(std::cout, elapsed, " ", rss, " ", status);
+			}
+
+			return 0;
+		}
+
+		const char* output = nullptr;
+		size_t runs = 5;
+		size_t size = 4 * 1024 * 1024;
+
+		std::vector<Workload> workloads;
+
+		for (int i = 1; i != argc; ++i) {
+			std::string_view arg = argv[i];
+
+			if (eq_any(arg, "-o", "-r", "-s")) {
+				if (i + 1 == argc) {
+					fatal("expected a value after `", arg, "`");
+				}
+
+				const char* value = argv[++i];
+
+				if (arg == "-o") {
+					output = value;
+				}
+
+				else if (arg == "-r") {
+					runs = std::strtoul(value, nullptr, 10);
+				}
+
+				else {
+					size = std::strtoul(value, nullptr, 10);
+				}
+			}
+
+			else {
+				workloads.push_back(file_workload(argv[i]));
+			}
+		}
+
+		if (workloads.empty()) {
+			workloads = default_workloads(size);
+		}
+
+		char dir[] = "/tmp/deck-bench-XXXXXX";
+
+		if (::mkdtemp(dir) == nullptr) {
+			fatal("cannot create temporary directory: ", std::strerror(errno));
+		}
+
+		std::string exe = std::string { dir } + "/a.out";
+		std::vector<Result> results;
+
+		for (const Workload& workload: workloads) {
+			Result result;
+
+			{
+				Source src = workload.load();
+
+				result.name = workload.name;
+				result.bytes = src.view.size();
+				result.compile = measure_compile(src, exe, result.compile_rss);
+			}
+
+			if (result.compile.ok) {
+				measure_runs(exe, runs, result);
+			}
+
+			const Compile& c = result.compile;
+
+			println(std::cerr,
+				workload.name, ": ",
+				c.ok ? "" : "(failed) ",
+				c.lex + c.parse + c.passes + c.lower + c.emit, " ms to compile, ",
+				median(result.runs), " ms to run");
+
+			results.push_back(std::move(result));
+			std::filesystem::remove(exe);
+		}
+
+		std::filesystem::remove(dir);
+
+		if (output == nullptr) {
+			write_json(std::cout, results);
+		}
+
+		else {
+			std::ofstream os { output };
+			write_json(os, results);
+		}
+	}
+
+	catch (const Exception& e) {
+		println(std::cerr, e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Compare the lexer's scanning kernels against each other.
+// Usage: deck-bench-lexer [file]
+// Without a file, a comment heavy source of a few megabytes is generated.
+
+#include <utility>
+#include <chrono>
+
+#include <string>
+#include <string_view>
+
+#include <iostream>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deck/deck.hpp>
+
+using namespace deck;
+
+namespace {
+	std::string generate(size_t lines) {
+		std::string src;
+
+		for (size_t i = 0; i != lines; ++i) {
+			src += "#! ( a b cont -> q ) a comment describing the word that follows it\n";
+			src += "$def word_" + std::to_string(i) + "    dup 1 + swap_items_around " + std::to_string(i) + " *\n";
+			src += "\t\t{ pop dup } [ 10 20 + ] &word_" + std::to_string(i) + " .\n\n";
+		}
+
+		return src;
+	}
+
+	size_t lex(std::string_view src) {
+		Interner interner;
+		Lexer lx { src, interner };
+
+		size_t count = 0;
+
+		while (lx.peek.kind != SymbolKind::Terminator) {
+			[[maybe_unused]] Symbol sym = lx.take();
+			++count;
+		}
+
+		return count;
+	}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+	try {
+		Source src = argc > 1 ? map_source(argv[1]) : make_source(generate(100'000));
+		std::string_view view = src.view;
+
+		constexpr size_t REPEAT = 10;
+
+		std::vector<detail::Scanner> scanners { detail::SCANNER_SCALAR };
+
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+		scanners.push_back(detail::SCANNER_SSE2);
+
+		if (__builtin_cpu_supports("avx2")) {
+			scanners.push_back(detail::SCANNER_AVX2);
+		}
+#endif
+
+		size_t expected = 0;
+
+		for (const detail::Scanner& scanner: scanners) {
+			detail::scanner() = scanner;
+
+			size_t tokens = lex(view);  // Warm up.
+
+			if (expected == 0) {
+				expected = tokens;
+			}
+
+			else if (tokens != expected) {
+				fatal(scanner.name, " produced ", tokens, " tokens, expected ", expected);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+
+			for (size_t i = 0; i != REPEAT; ++i) {
+				tokens = lex(view);
+			}
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			double mbps = static_cast<double>(view.size() * REPEAT) / elapsed.count() / (1024.0 * 1024.0);
+
+			println(std::cout, scanner.name, ": ", tokens, " tokens, ", mbps, " MiB/s");
+		}
+	}
+
+	catch (const Exception& e) {
+		println(std::cerr, e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef DECK_BYTECODE_HPP
+#define DECK_BYTECODE_HPP
+
+/*
+	Compact bytecode for the interpreter. A program is a flat array of
+	64-bit words where every instruction is an opcode followed by its
+	operands. Code addresses are word offsets into the program.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <string_view>
+#include <vector>
+
+#include <deck/deck.hpp>
+
+namespace deck::bc {
+	// Instructions mirror what the x86-64 backend emits in its canonical
+	// state so both can be tested against each other. The third column is
+	// the number of operand words.
+#define BYTECODES \
+	X(Push, "push", 1) \
+	X(Jmp, "jmp", 1) \
+	X(Call, "call", 1) \
+	X(Apply, "apply", 0) \
+	X(Exit, "exit", 0) \
+\
+	X(Add, "add", 0) \
+	X(Sub, "sub", 0) \
+	X(Mul, "mul", 0) \
+	X(Div, "div", 0) \
+	X(Mod, "mod", 0) \
+	X(Choose, "choose", 0) \
+\
+	X(AddImm, "add_imm", 1) \
+	X(SubImm, "sub_imm", 1) \
+	X(MulImm, "mul_imm", 1) \
+\
+	X(Pop, "pop", 0) \
+	X(Dup, "dup", 0) \
+	X(Count, "count", 0) \
+	X(Clear, "clear", 0) \
+	X(Enter, "enter", 0) \
+	X(Leave, "leave", 0) \
+\
+	X(Get, "get", 0) \
+	X(Set, "set", 0) \
+	X(Mget, "mget", 0) \
+	X(Mset, "mset", 0) \
+	X(DequePush, "deque_push", 0) \
+	X(DequePop, "deque_pop", 0)
+
+#define X(a, b, c) a,
+	enum class Opcode : uint64_t {
+		BYTECODES
+	};
+#undef X
+
+	namespace detail {
+#define X(a, b, c) b,
+		constexpr const char* OPCODE_TO_STR[] = { BYTECODES };
+#undef X
+
+#define X(a, b, c) c,
+		constexpr size_t OPCODE_OPERANDS[] = { BYTECODES };
+#undef X
+	}  // namespace detail
+
+	constexpr size_t OPCODE_COUNT = std::size(detail::OPCODE_TO_STR);
+
+	constexpr const char* opcode_to_str(Opcode x) {
+		return detail::OPCODE_TO_STR[static_cast<size_t>(x)];
+	}
+
+	constexpr size_t operand_count(Opcode x) {
+		return detail::OPCODE_OPERANDS[static_cast<size_t>(x)];
+	}
+
+	inline std::ostream& operator<<(std::ostream& os, Opcode x) {
+		return print(os, opcode_to_str(x));
+	}
+
+	// Runtime builtins from `core/builtins.asm` that have no syntax of their
+	// own. Programs get at them by declaring them with `$decl`.
+	struct Builtin {
+		std::string_view name;
+		Opcode op;
+	};
+
+	constexpr Builtin BUILTINS[] {
+		{ "get", Opcode::Get },
+		{ "set", Opcode::Set },
+		{ "mget", Opcode::Mget },
+		{ "mset", Opcode::Mset },
+		{ ">|", Opcode::DequePush },
+		{ "|>", Opcode::DequePop },
+	};
+
+	struct Program {
+		std::vector<uint64_t> code;
+
+		// Offsets of labels once placed. Operands that refer to a label hold
+		// its index until `link` patches in the offset.
+		std::vector<size_t> labels;
+		std::vector<std::pair<size_t, size_t>> fixups;  // (word, label)
+
+		// Offset of the last placed label. Instructions before it can't be
+		// merged with ones after it since something might jump in between.
+		size_t fence = 0;
+
+		size_t make_label() {
+			labels.push_back(SYMBOL_NONE);
+			return labels.size() - 1;
+		}
+
+		void place(size_t label) {
+			labels[label] = code.size();
+			fence = code.size();
+		}
+
+		void emit(Opcode op) {
+			DECK_ASSERT(operand_count(op) == 0);
+			code.push_back(static_cast<uint64_t>(op));
+		}
+
+		void emit(Opcode op, uint64_t imm) {
+			DECK_ASSERT(operand_count(op) == 1);
+
+			code.push_back(static_cast<uint64_t>(op));
+			code.push_back(imm);
+		}
+
+		void emit_label(Opcode op, size_t label) {
+			fixups.emplace_back(code.size() + 1, label);
+			emit(op, label);
+		}
+
+		void link() {
+			for (auto [word, label]: fixups) {
+				DECK_ASSERT(labels[label] != SYMBOL_NONE);
+				code[word] = labels[label];
+			}
+
+			fixups.clear();
+		}
+	};
+
+	// Calls `fn(offset, op)` for every instruction in order.
+	template <typename F>
+	inline void for_each(const Program& program, F&& fn) {
+		for (size_t i = 0; i < program.code.size(); i += 1 + operand_count(static_cast<Opcode>(program.code[i]))) {
+			fn(i, static_cast<Opcode>(program.code[i]));
+		}
+	}
+}  // namespace deck::bc
+
+#endif
@@ -7,15 +7,34 @@
 #include <memory>
 #include <utility>
 #include <algorithm>
+#include <iterator>
 #include <filesystem>
+#include <chrono>
+#include <array>
 
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <list>
+#include <charconv>
+#include <optional>
 
 #include <iostream>
+#include <sstream>
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Macros
 namespace deck {
@@ -137,25 +156,105 @@ namespace deck {
 		println(std::cerr, detail::log_to_str(Priority::Okay), " ", std::forward<Ts>(args)..., DECK_RESET);
 	}
 
-#define DECK_LOG(...) \
+	// The lowest priority `DECK_LOG` prints is fixed at compile time with
+	// `DECK_LOG_LEVEL` (see CMakeLists.txt). Anything below it compiles to
+	// nothing. `Okay` marks entry to a function and is the noisiest.
+#if defined(DECK_LOG_LEVEL)
+	constexpr Priority LOG_LEVEL = Priority::DECK_LOG_LEVEL;
+#elif defined(NDEBUG)
+	constexpr Priority LOG_LEVEL = Priority::Warn;
+#else
+	constexpr Priority LOG_LEVEL = Priority::Okay;
+#endif
+
+	namespace detail {
+		constexpr size_t log_rank(Priority x) {
+			switch (x) {
+				case Priority::Okay: return 0;
+				case Priority::Info: return 1;
+				case Priority::Warn: return 2;
+				case Priority::Fail: return 3;
+			}
+
+			return 0;
+		}
+
+		constexpr bool log_enabled(Priority x) {
+			return log_rank(x) >= log_rank(LOG_LEVEL);
+		}
+	}  // namespace detail
+
+	// With `DECK_TRACE_RING` defined, every `DECK_LOG` call site records a
+	// fixed size event in a ring buffer regardless of `LOG_LEVEL`. Nothing is
+	// formatted until the ring is dumped so it's cheap enough to leave on
+	// while chasing a problem in a large input.
+#if defined(DECK_TRACE_RING)
+#if not defined(DECK_TRACE_SIZE)
+#define DECK_TRACE_SIZE 4096
+#endif
+
+	struct TraceEvent {
+		const char* fn;
+		const char* file;
+		uint32_t line;
+		Priority priority;
+		uint64_t time;  // Nanoseconds since startup.
+	};
+
+	struct TraceRing {
+		static_assert((DECK_TRACE_SIZE & (DECK_TRACE_SIZE - 1)) == 0, "DECK_TRACE_SIZE must be a power of 2");
+
+		std::array<TraceEvent, DECK_TRACE_SIZE> events {};
+		size_t head = 0;  // Total number of events recorded.
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		void record(const char* fn, const char* file, uint32_t line, Priority priority) {
+			auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			events[head++ & (DECK_TRACE_SIZE - 1)] = { fn, file, line, priority, static_cast<uint64_t>(time.count()) };
+		}
+
+		// Oldest event first.
+		void dump(std::ostream& os) const {
+			size_t first = head > DECK_TRACE_SIZE ? head - DECK_TRACE_SIZE : 0;
+			println(os, "trace: ", head - first, " of ", head, " events");
+
+			for (size_t i = first; i != head; ++i) {
+				const TraceEvent& e = events[i & (DECK_TRACE_SIZE - 1)];
+				println(os, e.time / 1000, "us ", e.priority, DECK_RESET, " [", e.file, ":", e.line, "] `", e.fn, "`");
+			}
+		}
+	};
+
+	inline TraceRing trace_ring;
+
+#define DECK_TRACE_EVENT(priority) deck::trace_ring.record(__func__, __FILE__, __LINE__, priority)
+
+#else
+
+#define DECK_TRACE_EVENT(priority) \
 	do { \
-		[DECK_VAR(fn_name) = __func__]([[maybe_unused]] deck::Priority DECK_VAR(x), auto&&... DECK_VAR(args)) { \
-			using namespace std::string_view_literals; \
-			((deck::print(std::cerr, \
-				DECK_VAR(x), \
-				" [", \
-				std::filesystem::relative(__FILE__).native(), \
-				":", \
-				DECK_STR(__LINE__), \
-				"] "))); \
-			if (DECK_VAR(fn_name) != "operator()"sv) { \
-				((deck::print(std::cerr, "`", DECK_VAR(fn_name), "` "))); \
-			} \
-			if constexpr (sizeof...(DECK_VAR(args)) > 0) { \
-				((deck::print(std::cerr, DECK_RESET, std::forward<decltype(DECK_VAR(args))>(DECK_VAR(args))...))); \
-			} \
-			((deck::print(std::cerr, '\n', DECK_RESET))); \
-		}(__VA_ARGS__); \
+	} while (0)
+
+#endif
+
+#define DECK_LOG(priority, ...) \
+	do { \
+		DECK_TRACE_EVENT(priority); \
+		if constexpr (deck::detail::log_enabled(priority)) { \
+			[DECK_VAR(fn_name) = __func__]([[maybe_unused]] deck::Priority DECK_VAR(x), auto&&... DECK_VAR(args)) { \
+				using namespace std::string_view_literals; \
+				static const std::string DECK_VAR(file) = std::filesystem::relative(__FILE__).native(); \
+				((deck::print(std::cerr, DECK_VAR(x), " [", DECK_VAR(file), ":", DECK_STR(__LINE__), "] "))); \
+				if (DECK_VAR(fn_name) != "operator()"sv) { \
+					((deck::print(std::cerr, "`", DECK_VAR(fn_name), "` "))); \
+				} \
+				if constexpr (sizeof...(DECK_VAR(args)) > 0) { \
+					((deck::print(std::cerr, DECK_RESET, std::forward<decltype(DECK_VAR(args))>(DECK_VAR(args))...))); \
+				} \
+				((deck::print(std::cerr, '\n', DECK_RESET))); \
+			}(priority __VA_OPT__(, ) __VA_ARGS__); \
+		} \
 	} while (0)
 
 	// Exceptions
@@ -210,6 +309,85 @@ namespace deck {
 	[[nodiscard]] constexpr bool eq_none(T&& first, Ts&&... rest) {
 		return ((std::forward<T>(first) != std::forward<Ts>(rest)) and ...);
 	}
+
+	// Value of an integer literal. Literals are unsigned and must fit in
+	// 64 bits.
+	inline std::optional<uint64_t> parse_integer(std::string_view str) {
+		uint64_t value = 0;
+		auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+
+		if (ec != std::errc {} or ptr != str.data() + str.size()) {
+			return std::nullopt;
+		}
+
+		return value;
+	}
+}  // namespace deck
+
+// Source
+namespace deck {
+	// A read-only source buffer along with whatever owns its memory.
+	// Symbols refer directly into `view` so the owner must be kept alive
+	// for as long as the tree is.
+	struct Source {
+		std::shared_ptr<const void> owner;
+		std::string_view view;
+	};
+
+	[[nodiscard]] inline Source make_source(std::string&& str) {
+		auto owner = std::make_shared<const std::string>(std::move(str));
+		return { owner, *owner };
+	}
+
+	// Fallback for when we can't map the input (i.e. pipes).
+	[[nodiscard]] inline Source read_source(std::istream& is) {
+		std::ostringstream ss;
+		ss << is.rdbuf();
+
+		return make_source(std::move(ss).str());
+	}
+
+	// Map a file read-only and lex it in place.
+	[[nodiscard]] inline Source map_source(const char* path) {
+		int fd = ::open(path, O_RDONLY);
+
+		if (fd == -1) {
+			fatal("cannot open `", path, "`: ", std::strerror(errno));
+		}
+
+		struct stat st;
+
+		if (::fstat(fd, &st) == -1) {
+			int err = errno;
+			::close(fd);
+			fatal("cannot stat `", path, "`: ", std::strerror(err));
+		}
+
+		size_t size = st.st_size;
+
+		// `mmap` refuses zero length mappings.
+		if (size == 0) {
+			::close(fd);
+			return make_source({});
+		}
+
+		void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		int err = errno;
+
+		::close(fd);
+
+		if (addr == MAP_FAILED) {
+			fatal("cannot map `", path, "`: ", std::strerror(err));
+		}
+
+		::madvise(addr, size, MADV_SEQUENTIAL);
+
+		std::shared_ptr<const void> owner { addr, [size](const void* ptr) {
+			::munmap(const_cast<void*>(ptr), size);
+		} };
+
+		return { owner, { static_cast<const char*>(addr), size } };
+	}
 }  // namespace deck
 
 // Lexer
@@ -234,6 +412,226 @@ namespace deck {
 		return x >= '0' and x <= '9';
 	}
 
+	// Scanning kernels used by the lexer to skip over runs of characters.
+	// Each kernel returns a pointer to the first character in `[ptr, end)`
+	// that doesn't belong to the run (or `end`). The vectorised versions
+	// classify 16 or 32 bytes at a time and fall back to the scalar loop
+	// for the tail.
+	namespace detail {
+		using ScanFn = const char* (*)(const char*, const char*);
+
+		struct Scanner {
+			const char* name;
+
+			ScanFn skip_whitespace;
+			ScanFn skip_visible;
+			ScanFn find_newline;
+		};
+
+		inline const char* skip_whitespace_scalar(const char* ptr, const char* end) {
+			while (ptr != end and is_whitespace(ptr)) {
+				++ptr;
+			}
+
+			return ptr;
+		}
+
+		inline const char* skip_visible_scalar(const char* ptr, const char* end) {
+			while (ptr != end and is_visible(ptr)) {
+				++ptr;
+			}
+
+			return ptr;
+		}
+
+		inline const char* find_newline_scalar(const char* ptr, const char* end) {
+			while (ptr != end and *ptr != '\n') {
+				++ptr;
+			}
+
+			return ptr;
+		}
+
+		constexpr Scanner SCANNER_SCALAR {
+			"scalar",
+			skip_whitespace_scalar,
+			skip_visible_scalar,
+			find_newline_scalar,
+		};
+
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+		// `(x - lo) <= (hi - lo)` as an unsigned comparison checks that `x`
+		// is in the range `[lo, hi]`. SSE2 has no unsigned byte comparison
+		// but `min(x, n) == x` is equivalent to `x <= n`.
+		inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+			__m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+			return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+		}
+
+		inline uint32_t whitespace_mask_sse2(__m128i x) {
+			__m128i ws = _mm_or_si128(in_range_sse2(x, 9, 13), _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+			return _mm_movemask_epi8(ws);
+		}
+
+		inline uint32_t visible_mask_sse2(__m128i x) {
+			return _mm_movemask_epi8(in_range_sse2(x, 33, 126));
+		}
+
+		inline uint32_t newline_mask_sse2(__m128i x) {
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+		}
+
+		// Skip 16 byte chunks while `mask_fn` reports every byte as part of
+		// the run. `Invert` is used when searching for a single character.
+		template <bool Invert, typename F>
+		inline const char* scan_sse2(const char* ptr, const char* end, F&& mask_fn) {
+			while (end - ptr >= 16) {
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+				uint32_t mask = mask_fn(x);
+
+				if constexpr (not Invert) {
+					mask = ~mask & 0xFFFF;
+				}
+
+				if (mask != 0) {
+					return ptr + __builtin_ctz(mask);
+				}
+
+				ptr += 16;
+			}
+
+			return ptr;
+		}
+
+		inline const char* skip_whitespace_sse2(const char* ptr, const char* end) {
+			return skip_whitespace_scalar(scan_sse2<false>(ptr, end, whitespace_mask_sse2), end);
+		}
+
+		inline const char* skip_visible_sse2(const char* ptr, const char* end) {
+			return skip_visible_scalar(scan_sse2<false>(ptr, end, visible_mask_sse2), end);
+		}
+
+		inline const char* find_newline_sse2(const char* ptr, const char* end) {
+			return find_newline_scalar(scan_sse2<true>(ptr, end, newline_mask_sse2), end);
+		}
+
+		constexpr Scanner SCANNER_SSE2 {
+			"sse2",
+			skip_whitespace_sse2,
+			skip_visible_sse2,
+			find_newline_sse2,
+		};
+
+#define DECK_AVX2 __attribute__((target("avx2")))
+
+		DECK_AVX2 inline __m256i in_range_avx2(__m256i x, char lo, char hi) {
+			__m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+			return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+		}
+
+		DECK_AVX2 inline uint32_t whitespace_mask_avx2(__m256i x) {
+			__m256i ws = _mm256_or_si256(in_range_avx2(x, 9, 13), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+			return _mm256_movemask_epi8(ws);
+		}
+
+		DECK_AVX2 inline uint32_t visible_mask_avx2(__m256i x) {
+			return _mm256_movemask_epi8(in_range_avx2(x, 33, 126));
+		}
+
+		DECK_AVX2 inline uint32_t newline_mask_avx2(__m256i x) {
+			return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+		}
+
+		// Lambdas can't carry a target attribute portably so the loop is
+		// spelled out for each kernel instead of sharing a template.
+#define DECK_SCAN_AVX2(ptr, end, mask_expr) \
+	do { \
+		while (end - ptr >= 32) { \
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); \
+			uint32_t mask = (mask_expr); \
+\
+			if (mask != 0) { \
+				return ptr + __builtin_ctz(mask); \
+			} \
+\
+			ptr += 32; \
+		} \
+	} while (0)
+
+		DECK_AVX2 inline const char* skip_whitespace_avx2(const char* ptr, const char* end) {
+			DECK_SCAN_AVX2(ptr, end, ~whitespace_mask_avx2(x));
+			return skip_whitespace_sse2(ptr, end);
+		}
+
+		DECK_AVX2 inline const char* skip_visible_avx2(const char* ptr, const char* end) {
+			DECK_SCAN_AVX2(ptr, end, ~visible_mask_avx2(x));
+			return skip_visible_sse2(ptr, end);
+		}
+
+		DECK_AVX2 inline const char* find_newline_avx2(const char* ptr, const char* end) {
+			DECK_SCAN_AVX2(ptr, end, newline_mask_avx2(x));
+			return find_newline_sse2(ptr, end);
+		}
+
+#undef DECK_SCAN_AVX2
+#undef DECK_AVX2
+
+		constexpr Scanner SCANNER_AVX2 {
+			"avx2",
+			skip_whitespace_avx2,
+			skip_visible_avx2,
+			find_newline_avx2,
+		};
+
+		inline Scanner select_scanner() {
+			if (__builtin_cpu_supports("avx2")) {
+				return SCANNER_AVX2;
+			}
+
+			return SCANNER_SSE2;  // SSE2 is part of the x86-64 baseline.
+		}
+#else
+		inline Scanner select_scanner() {
+			return SCANNER_SCALAR;
+		}
+#endif
+
+		// Picked once at startup. Exposed as a mutable reference so that
+		// benchmarks can swap in a specific kernel.
+		inline Scanner& scanner() {
+			static Scanner active = select_scanner();
+			return active;
+		}
+	}  // namespace detail
+
+	// Most runs are only a few characters long so we scan a short prefix
+	// before paying for a call into a kernel.
+	constexpr size_t SCAN_PREFIX = 8;
+
+	inline const char* skip_whitespace(const char* ptr, const char* end) {
+		for (size_t i = 0; i != SCAN_PREFIX; ++i, ++ptr) {
+			if (ptr == end or not is_whitespace(ptr)) {
+				return ptr;
+			}
+		}
+
+		return detail::scanner().skip_whitespace(ptr, end);
+	}
+
+	inline const char* skip_visible(const char* ptr, const char* end) {
+		for (size_t i = 0; i != SCAN_PREFIX; ++i, ++ptr) {
+			if (ptr == end or not is_visible(ptr)) {
+				return ptr;
+			}
+		}
+
+		return detail::scanner().skip_visible(ptr, end);
+	}
+
+	inline const char* find_newline(const char* ptr, const char* end) {
+		return detail::scanner().find_newline(ptr, end);
+	}
+
 #define SYMBOL_KINDS \
 	X(None, "None") \
 	X(Terminator, "Terminator") \
@@ -260,7 +658,7 @@ namespace deck {
 	X(End, "End")
 
 #define X(a, b) a,
-	enum class SymbolKind : size_t {
+	enum class SymbolKind : uint8_t {
 		SYMBOL_KINDS
 	};
 #undef X
@@ -279,11 +677,92 @@ namespace deck {
 		return print(os, detail::symbol_to_str(x));
 	}
 
+#define PRIMITIVES \
+	X(Add, "+") \
+	X(Sub, "-") \
+	X(Mul, "*") \
+	X(Div, "/") \
+	X(Mod, "%") \
+\
+	X(Choose, "?") \
+	X(Call, ".") \
+\
+	X(Pop, "pop") \
+	X(Dup, "dup") \
+	X(Count, "#") \
+	X(Clear, "clear")
+
+#define X(a, b) a,
+	enum class Primitive : size_t {
+		PRIMITIVES
+	};
+#undef X
+
+	namespace detail {
+#define X(a, b) b,
+		constexpr const char* PRIMITIVE_TO_STR[] = { PRIMITIVES };
+#undef X
+
+		constexpr const char* primitive_to_str(Primitive x) {
+			return detail::PRIMITIVE_TO_STR[static_cast<size_t>(x)];
+		}
+	}  // namespace detail
+
+	inline std::ostream& operator<<(std::ostream& os, Primitive x) {
+		return print(os, detail::primitive_to_str(x));
+	}
+
+	// Symbols without an interned string (literals, delimiters etc.)
+	constexpr size_t SYMBOL_NONE = static_cast<size_t>(-1);
+
+	// Number of IDs reserved for primitives. Every ID below this value
+	// can be cast directly to `Primitive`.
+	constexpr size_t PRIMITIVE_COUNT = std::size(detail::PRIMITIVE_TO_STR);
+
+	constexpr bool is_primitive(size_t id) {
+		return id < PRIMITIVE_COUNT;
+	}
+
+	// Maps every distinct identifier to a dense integer ID so that later
+	// passes can use plain array lookups instead of hashing strings.
+	// Primitives are interned up front in the order of `PRIMITIVES`.
+	struct Interner {
+		std::unordered_map<std::string_view, size_t> ids;
+		std::vector<std::string_view> strings;
+
+		Interner() {
+			for (const char* str: detail::PRIMITIVE_TO_STR) {
+				intern(str);
+			}
+		}
+
+		size_t intern(std::string_view str) {
+			auto [it, succ] = ids.try_emplace(str, strings.size());
+
+			if (succ) {
+				strings.push_back(str);
+			}
+
+			return it->second;
+		}
+
+		std::string_view str(size_t id) const {
+			return strings[id];
+		}
+
+		size_t size() const {
+			return strings.size();
+		}
+	};
+
+	// Symbols are views into the source buffer owned by the `Tree` so
+	// lexing never has to allocate.
 	struct Symbol {
-		std::string str;
+		std::string_view str;
 		SymbolKind kind;
+		size_t id;
 
-		Symbol(std::string str_, SymbolKind kind_): str(str_), kind(kind_) {}
+		Symbol(std::string_view str_, SymbolKind kind_, size_t id_ = SYMBOL_NONE): str(str_), kind(kind_), id(id_) {}
 	};
 
 	inline std::ostream& operator<<(std::ostream& os, Symbol x) {
@@ -291,6 +770,10 @@ namespace deck {
 	}
 
 	inline bool operator==(Symbol lhs, Symbol rhs) {
+		if (lhs.id != SYMBOL_NONE and rhs.id != SYMBOL_NONE) {
+			return lhs.kind == rhs.kind and lhs.id == rhs.id;
+		}
+
 		return lhs.kind == rhs.kind and lhs.str == rhs.str;
 	}
 
@@ -298,27 +781,36 @@ namespace deck {
 		return not(lhs == rhs);
 	}
 
+	// The lexer does not own `src`, it must outlive every symbol produced.
+	// Lexing stops at `end` so `src` doesn't need to be NUL terminated which
+	// lets us lex memory mapped files in place. Identifiers are interned as
+	// they are lexed.
 	struct Lexer {
-		std::string src;
+		std::string_view src;
 		const char* ptr;
+		const char* end;
 
+		Interner& interner;
 		Symbol peek;
 
-		Lexer(std::string&& src_): src(std::move(src_)), ptr(src.data()), peek("", SymbolKind::None) {
-			Symbol sym = take();
+		Lexer(std::string_view src_, Interner& interner_):
+				src(src_),
+				ptr(src.data()),
+				end(src.data() + src.size()),
+				interner(interner_),
+				peek("", SymbolKind::None) {
+			[[maybe_unused]] Symbol sym = take();
 		}
 
 		[[nodiscard]] inline Symbol take() {
-			while (is_whitespace(ptr)) {
-				++ptr;
-			}
+			ptr = skip_whitespace(ptr, end);
 
 			const char* begin = ptr;
 			size_t length = 0;
 
 			SymbolKind kind = SymbolKind::None;
 
-			if (*ptr == '\0') {  // EOF
+			if (ptr == end) {  // EOF
 				kind = SymbolKind::Terminator;
 			}
 
@@ -345,34 +837,32 @@ namespace deck {
 			else if (*ptr == '$') {
 				kind = SymbolKind::Intrinsic;
 				begin = ++ptr;
-
-				while (is_visible(ptr)) {
-					++ptr;
-				}
+				ptr = skip_visible(ptr, end);
 			}
 
 			else if (*ptr == '&') {
 				kind = SymbolKind::Address;
 				begin = ++ptr;
-
-				while (is_visible(ptr)) {
-					++ptr;
-				}
+				ptr = skip_visible(ptr, end);
 			}
 
 			else if (*ptr == '"') {
 				kind = SymbolKind::String;
 				begin = ++ptr;
 
-				while (*ptr != '"') {
+				while (ptr != end and *ptr != '"') {
 					++ptr;
 				}
+
+				if (ptr == end) {
+					fatal("unterminated string");
+				}
 			}
 
 			else if (is_digit(ptr)) {
 				kind = SymbolKind::Integer;
 
-				while (is_digit(ptr)) {
+				while (ptr != end and is_digit(ptr)) {
 					++ptr;
 				}
 			}
@@ -383,20 +873,13 @@ namespace deck {
 				if (*ptr == '#') {
 					++ptr;
 
-					if (*ptr == '!') {
-						++ptr;
-
-						while (*ptr != '\n') {
-							++ptr;
-						}
-
+					if (ptr != end and *ptr == '!') {
+						ptr = find_newline(ptr + 1, end);
 						return take();
 					}
 				}
 
-				while (is_visible(ptr)) {
-					++ptr;
-				}
+				ptr = skip_visible(ptr, end);
 			}
 
 			else {
@@ -408,6 +891,12 @@ namespace deck {
 			Symbol sym { { begin, length }, kind };
 			Symbol out = peek;
 
+			// Only `&name` is interned here. `$addr` becomes an `Address`
+			// too but without an ID since its name is the next token.
+			if (eq_any(sym.kind, SymbolKind::Identifier, SymbolKind::Address)) {
+				sym.id = interner.intern(sym.str);
+			}
+
 			if (sym.kind == SymbolKind::Intrinsic) {
 				if (sym.str == "decl") {
 					sym.kind = SymbolKind::Declare;
@@ -448,20 +937,186 @@ namespace deck {
 
 // Parser
 namespace deck {
-	using Tree = std::vector<Symbol>;
+	// Net stack effect of jumping to a block: the number of slots below the
+	// top it consumes and how many it leaves in their place. Blocks that
+	// return through a continuation count it as one of their inputs.
+	struct Effect {
+		size_t in = 0;
+		size_t out = 0;
+	};
+
+	inline bool operator==(Effect lhs, Effect rhs) {
+		return lhs.in == rhs.in and lhs.out == rhs.out;
+	}
+
+	inline bool operator!=(Effect lhs, Effect rhs) {
+		return not(lhs == rhs);
+	}
+
+	inline std::ostream& operator<<(std::ostream& os, Effect x) {
+		return print(os, "( ", x.in, " -> ", x.out, " )");
+	}
+
+	// Everything about a symbol except its kind.
+	struct SymbolSpan {
+		std::string_view str;
+		size_t id;
+	};
+
+	// Symbols stored column by column. Kinds are a byte each so passes that
+	// mostly look at kinds stay in cache, and every `Frame` or `Quote`
+	// records the index of its `End` so a block can be skipped without
+	// looking inside it. Symbols are handed out by value.
+	struct Symbols {
+		std::vector<SymbolKind> kinds;
+		std::vector<SymbolSpan> spans;
+		std::vector<size_t> ends;  // Index of the matching `End` or `SYMBOL_NONE`.
+
+		std::vector<size_t> open;  // Blocks we haven't seen the `End` of yet.
+
+		struct iterator {
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = Symbol;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = Symbol;
+
+			const Symbols* symbols = nullptr;
+			size_t index = 0;
+
+			Symbol operator*() const {
+				return (*symbols)[index];
+			}
+
+			iterator& operator++() {
+				++index;
+				return *this;
+			}
+
+			iterator operator++(int) {
+				iterator copy = *this;
+				++index;
+				return copy;
+			}
+
+			friend bool operator==(iterator lhs, iterator rhs) {
+				return lhs.index == rhs.index;
+			}
+
+			friend difference_type operator-(iterator lhs, iterator rhs) {
+				return static_cast<difference_type>(lhs.index) - static_cast<difference_type>(rhs.index);
+			}
+		};
+
+		using const_iterator = iterator;
+
+		Symbol operator[](size_t i) const {
+			return { spans[i].str, kinds[i], spans[i].id };
+		}
+
+		size_t size() const {
+			return kinds.size();
+		}
+
+		bool empty() const {
+			return kinds.empty();
+		}
+
+		iterator begin() const {
+			return { this, 0 };
+		}
+
+		iterator end() const {
+			return { this, size() };
+		}
+
+		// Index of the `End` closing the block opened at `i` or
+		// `SYMBOL_NONE` if it hasn't been closed.
+		size_t end_of(size_t i) const {
+			return ends[i];
+		}
+
+		void reserve(size_t n) {
+			kinds.reserve(n);
+			spans.reserve(n);
+			ends.reserve(n);
+		}
+
+		void push_back(Symbol sym) {
+			emplace_back(sym.str, sym.kind, sym.id);
+		}
+
+		void emplace_back(std::string_view str, SymbolKind kind, size_t id = SYMBOL_NONE) {
+			size_t i = size();
+
+			kinds.push_back(kind);
+			spans.push_back({ str, id });
+			ends.push_back(SYMBOL_NONE);
+
+			if (eq_any(kind, SymbolKind::Frame, SymbolKind::Quote)) {
+				open.push_back(i);
+			}
+
+			else if (kind == SymbolKind::End) {
+				if (open.empty()) {
+					fatal("invalid tree");
+				}
+
+				ends[open.back()] = i;
+				open.pop_back();
+			}
+		}
+	};
+
+	// Flat representation of the program. The tree keeps the source buffer
+	// alive for as long as any of its symbols might refer to it. Passes that
+	// synthesize new symbols store their text in `strings`, a list so that
+	// existing views stay valid as it grows.
+	struct Tree {
+		using iterator = Symbols::iterator;
+		using const_iterator = Symbols::const_iterator;
+
+		Source src;
+		Symbols symbols;
+		Interner interner;
+		std::list<std::string> strings;
+
+		// Filled in by `passes::effects`. Labels are keyed by interned ID
+		// and quotes by the index of their opening symbol so any pass that
+		// moves symbols around has to run before it.
+		std::unordered_map<size_t, Effect> label_effects;
+		std::unordered_map<size_t, Effect> quote_effects;
+
+		std::string_view own(std::string str) {
+			return strings.emplace_back(std::move(str));
+		}
+
+		iterator begin() const {
+			return symbols.begin();
+		}
+
+		iterator end() const {
+			return symbols.end();
+		}
+
+		size_t size() const {
+			return symbols.size();
+		}
+	};
 
 	inline bool is_intrinsic(Symbol x) {
 		return eq_any(x.kind, SymbolKind::Declare, SymbolKind::Label, SymbolKind::Address);
 	}
 
-	inline void expression(std::vector<Symbol>&, Lexer&);
-	inline void frame(std::vector<Symbol>&, Lexer&);
-	inline void quote(std::vector<Symbol>&, Lexer&);
-	inline void intrinsic(std::vector<Symbol>&, Lexer&);
+	inline void expression(Symbols&, Lexer&);
+	inline void frame(Symbols&, Lexer&);
+	inline void quote(Symbols&, Lexer&);
+	inline void intrinsic(Symbols&, Lexer&);
 
-	[[nodiscard]] inline std::vector<Symbol> parse(std::string&&);
+	[[nodiscard]] inline Tree parse(Source);
+	[[nodiscard]] inline Tree parse(std::string&&);
 
-	inline void frame(std::vector<Symbol>& prog, Lexer& lx) {
+	inline void frame(Symbols& prog, Lexer& lx) {
 		DECK_LOG(Priority::Okay);
 
 		expect(lx, is(SymbolKind::Frame), "expected `[`");
@@ -479,7 +1134,7 @@ namespace deck {
 		prog.emplace_back(frame_end.str, SymbolKind::End);
 	}
 
-	inline void quote(std::vector<Symbol>& prog, Lexer& lx) {
+	inline void quote(Symbols& prog, Lexer& lx) {
 		DECK_LOG(Priority::Okay);
 
 		expect(lx, is(SymbolKind::Quote), "expected `{`");
@@ -497,7 +1152,7 @@ namespace deck {
 		prog.emplace_back(quote_end.str, SymbolKind::End);
 	}
 
-	inline void intrinsic(std::vector<Symbol>& prog, Lexer& lx) {
+	inline void intrinsic(Symbols& prog, Lexer& lx) {
 		DECK_LOG(Priority::Okay);
 
 		expect(lx, is_intrinsic, "expected an intrinsic");
@@ -506,10 +1161,10 @@ namespace deck {
 		expect(lx, is(SymbolKind::Identifier), "expected an identifer");
 		Symbol ident = lx.take();
 
-		prog.emplace_back(ident.str, intrinsic.kind);
+		prog.emplace_back(ident.str, intrinsic.kind, ident.id);
 	}
 
-	inline void expression(std::vector<Symbol>& prog, Lexer& lx) {
+	inline void expression(Symbols& prog, Lexer& lx) {
 		DECK_LOG(Priority::Okay);
 
 		switch (lx.peek.kind) {
@@ -517,22 +1172,35 @@ namespace deck {
 			case SymbolKind::Quote: quote(prog, lx); break;
 
 			case SymbolKind::Declare:
-			case SymbolKind::Label:
-			case SymbolKind::Address: {
+			case SymbolKind::Label: {
 				intrinsic(prog, lx);
 			} break;
 
+			// `&name` is lexed as a single token with its name interned
+			// while `$addr name` is two.
+			case SymbolKind::Address: {
+				if (lx.peek.id == SYMBOL_NONE) {
+					intrinsic(prog, lx);
+					break;
+				}
+
+				prog.push_back(lx.take());
+			} break;
+
 			default: {
 				prog.push_back(lx.take());
 			};
 		}
 	}
 
-	[[nodiscard]] inline std::vector<Symbol> parse(std::string&& src) {
+	[[nodiscard]] inline Tree parse(Source src) {
 		DECK_LOG(Priority::Okay);
 
-		Lexer lx { std::move(src) };
-		std::vector<Symbol> prog;
+		Tree tree;
+		tree.src = std::move(src);
+
+		Lexer lx { tree.src.view, tree.interner };
+		Symbols& prog = tree.symbols;
 
 		prog.emplace_back(lx.peek.str, SymbolKind::Header);
 
@@ -542,7 +1210,11 @@ namespace deck {
 
 		prog.emplace_back(lx.peek.str, SymbolKind::Footer);
 
-		return prog;
+		return tree;
+	}
+
+	[[nodiscard]] inline Tree parse(std::string&& src) {
+		return parse(make_source(std::move(src)));
 	}
 
 }  // namespace deck
@@ -563,18 +1235,26 @@ namespace deck {
 
 	// Visit a block (i.e. a run of code terminated by `end`).
 	// This is a common pattern that shows up in most visitors that
-	// traverse the AST like a tree rather than a vector.
+	// traverse the AST like a tree rather than a vector. `it` is the first
+	// symbol inside the block. Returns the symbol after `end` so an
+	// enclosing block doesn't stop at it.
 	template <typename F, typename... Ts>
 	inline Tree::iterator visit_block(F&& fn, Tree& tree, Tree::iterator it, Ts&&... args) {
-		while (it != tree.end() and eq_none(it->kind, SymbolKind::End, SymbolKind::Terminator)) {
+		size_t end = tree.symbols.end_of(it.index - 1);
+
+		if (end == SYMBOL_NONE) {
+			fatal("invalid tree");
+		}
+
+		while (it.index < end) {
 			it = visitor(fn, tree, it, std::forward<Ts>(args)...);
 		}
 
-		if (it->kind != SymbolKind::End) {
+		if (it.index != end) {
 			fatal("invalid tree");
 		}
 
-		return it;
+		return ++it;
 	}
 
 	// Runs a pass by visiting every top level node until EOF is reached.
@@ -582,7 +1262,7 @@ namespace deck {
 	inline Tree::iterator pass(F&& fn, Tree& tree, Ts&&... args) {
 		Tree::iterator it = tree.begin();
 
-		while (it != tree.end() and it->kind != SymbolKind::Terminator) {
+		while (it != tree.end() and tree.symbols.kinds[it.index] != SymbolKind::Terminator) {
 			it = visitor(fn, tree, it, std::forward<Ts>(args)...);
 		}
 
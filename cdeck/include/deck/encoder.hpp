@@ -0,0 +1,378 @@
+#ifndef DECK_ENCODER_HPP
+#define DECK_ENCODER_HPP
+
+/*
+	Machine code encoder for the subset of x86-64 in `deck/x86.hpp`.
+	Only 64 bit registers are used so every instruction that takes a
+	register operand carries `REX.W`.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <utility>
+#include <vector>
+#include <initializer_list>
+
+#include <deck/deck.hpp>
+#include <deck/x86.hpp>
+
+namespace deck::x86 {
+	constexpr size_t LABEL_UNPLACED = static_cast<size_t>(-1);
+
+	// Encoded program. Label offsets are relative to the start of `bytes`.
+	struct Code {
+		std::vector<uint8_t> bytes;
+		std::vector<size_t> labels;
+	};
+
+	namespace detail {
+		enum class FixupKind {
+			Rel32,  // Displacement from the end of the field.
+			Abs64,  // Absolute address given the base address.
+		};
+
+		struct Fixup {
+			FixupKind kind;
+			size_t offset;
+			size_t label;
+		};
+
+		// Hardware register numbers which don't follow the order of
+		// `Register`.
+		constexpr size_t reg_index(Register r) {
+			switch (r) {
+				case Register::Rax: return 0;
+				case Register::Rcx: return 1;
+				case Register::Rdx: return 2;
+				case Register::Rbx: return 3;
+				case Register::Rsp: return 4;
+				case Register::Rbp: return 5;
+				case Register::Rsi: return 6;
+				case Register::Rdi: return 7;
+
+				default: return static_cast<size_t>(r);  // r8-r15 line up.
+			}
+		}
+
+		constexpr bool is_imm8(Operand x) {
+			auto value = static_cast<int64_t>(x.imm);
+			return is_imm(x) and value >= std::numeric_limits<int8_t>::min() and
+				value <= std::numeric_limits<int8_t>::max();
+		}
+
+		// Opcodes for the `op r/m64, r64` form and the `/digit` used with
+		// the `op r/m64, imm` forms (0x81 and 0x83).
+		struct AluEncoding {
+			uint8_t rm_reg;
+			uint8_t digit;
+		};
+
+		constexpr AluEncoding alu_encoding(Opcode op) {
+			switch (op) {
+				case Opcode::Add: return { 0x01, 0 };
+				case Opcode::Sub: return { 0x29, 5 };
+				case Opcode::Xor: return { 0x31, 6 };
+				case Opcode::Cmp: return { 0x39, 7 };
+				default: return { 0, 0 };
+			}
+		}
+
+		struct Encoder {
+			Code& code;
+			std::vector<Fixup> fixups;
+
+			Encoder(Code& code_): code(code_) {}
+
+			void byte(uint8_t x) {
+				code.bytes.push_back(x);
+			}
+
+			void imm32(uint64_t x) {
+				for (size_t i = 0; i != 4; ++i) {
+					byte(static_cast<uint8_t>(x >> (i * 8)));
+				}
+			}
+
+			void imm64(uint64_t x) {
+				for (size_t i = 0; i != 8; ++i) {
+					byte(static_cast<uint8_t>(x >> (i * 8)));
+				}
+			}
+
+			// Omitted entirely when no bits are set.
+			void rex(bool w, size_t reg, size_t rm) {
+				uint8_t x = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+
+				if (x != 0x40) {
+					byte(x);
+				}
+			}
+
+			void modrm(size_t reg, size_t rm) {
+				byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+			}
+
+			// `op r/m64, r64` or `op r64, r/m64` depending on the opcode.
+			void reg_reg(std::initializer_list<uint8_t> opcode, size_t reg, size_t rm) {
+				rex(true, reg, rm);
+
+				for (uint8_t x: opcode) {
+					byte(x);
+				}
+
+				modrm(reg, rm);
+			}
+
+			void fixup(FixupKind kind, size_t label) {
+				fixups.push_back({ kind, code.bytes.size(), label });
+
+				if (kind == FixupKind::Rel32) {
+					imm32(0);
+				}
+
+				else {
+					imm64(0);
+				}
+			}
+		};
+
+		[[noreturn]] inline void unencodable(const Instruction& instr) {
+			fatal("cannot encode `", instr.op, "` with these operands");
+		}
+
+		inline void encode_instruction(Encoder& enc, const Instruction& instr) {
+			auto [op, dst, src] = instr;
+
+			switch (op) {
+				case Opcode::Label: {
+					enc.code.labels[dst.label] = enc.code.bytes.size();
+				} break;
+
+				case Opcode::Mov: {
+					if (not is_reg(dst)) {
+						unencodable(instr);
+					}
+
+					size_t d = reg_index(dst.reg);
+
+					if (is_reg(src)) {
+						enc.reg_reg({ 0x89 }, reg_index(src.reg), d);
+					}
+
+					// Labels always get a full 64 bit slot so the code doesn't
+					// depend on where it ends up being loaded.
+					else if (src.kind == OperandKind::Label) {
+						enc.rex(true, 0, d);
+						enc.byte(0xB8 + (d & 7));
+						enc.fixup(FixupKind::Abs64, src.label);
+					}
+
+					else if (is_imm32(src)) {
+						enc.rex(true, 0, d);
+						enc.byte(0xC7);
+						enc.modrm(0, d);
+						enc.imm32(src.imm);
+					}
+
+					else if (src.imm <= std::numeric_limits<uint32_t>::max()) {
+						enc.rex(false, 0, d);  // Writes to 32 bit registers zero extend.
+						enc.byte(0xB8 + (d & 7));
+						enc.imm32(src.imm);
+					}
+
+					else {
+						enc.rex(true, 0, d);
+						enc.byte(0xB8 + (d & 7));
+						enc.imm64(src.imm);
+					}
+				} break;
+
+				case Opcode::Push: {
+					if (is_reg(dst)) {
+						enc.rex(false, 0, reg_index(dst.reg));
+						enc.byte(0x50 + (reg_index(dst.reg) & 7));
+					}
+
+					else if (is_imm8(dst)) {
+						enc.byte(0x6A);
+						enc.byte(static_cast<uint8_t>(dst.imm));
+					}
+
+					else if (is_imm32(dst)) {
+						enc.byte(0x68);
+						enc.imm32(dst.imm);
+					}
+
+					else {
+						unencodable(instr);
+					}
+				} break;
+
+				case Opcode::Pop: {
+					if (not is_reg(dst)) {
+						unencodable(instr);
+					}
+
+					enc.rex(false, 0, reg_index(dst.reg));
+					enc.byte(0x58 + (reg_index(dst.reg) & 7));
+				} break;
+
+				case Opcode::Add:
+				case Opcode::Sub:
+				case Opcode::Xor:
+				case Opcode::Cmp: {
+					auto [rm_reg, digit] = alu_encoding(op);
+
+					if (not is_reg(dst)) {
+						unencodable(instr);
+					}
+
+					size_t d = reg_index(dst.reg);
+
+					if (is_reg(src)) {
+						enc.reg_reg({ rm_reg }, reg_index(src.reg), d);
+					}
+
+					else if (is_imm8(src)) {
+						enc.rex(true, 0, d);
+						enc.byte(0x83);
+						enc.modrm(digit, d);
+						enc.byte(static_cast<uint8_t>(src.imm));
+					}
+
+					else if (is_imm32(src)) {
+						enc.rex(true, 0, d);
+						enc.byte(0x81);
+						enc.modrm(digit, d);
+						enc.imm32(src.imm);
+					}
+
+					else {
+						unencodable(instr);
+					}
+				} break;
+
+				case Opcode::Imul: {
+					if (not is_reg(dst)) {
+						unencodable(instr);
+					}
+
+					size_t d = reg_index(dst.reg);
+
+					if (is_reg(src)) {
+						enc.reg_reg({ 0x0F, 0xAF }, d, reg_index(src.reg));
+					}
+
+					else if (is_imm8(src)) {
+						enc.reg_reg({ 0x6B }, d, d);
+						enc.byte(static_cast<uint8_t>(src.imm));
+					}
+
+					else if (is_imm32(src)) {
+						enc.reg_reg({ 0x69 }, d, d);
+						enc.imm32(src.imm);
+					}
+
+					else {
+						unencodable(instr);
+					}
+				} break;
+
+				case Opcode::Div: {
+					if (not is_reg(dst)) {
+						unencodable(instr);
+					}
+
+					enc.reg_reg({ 0xF7 }, 6, reg_index(dst.reg));
+				} break;
+
+				case Opcode::Shr: {
+					if (not is_reg(dst) or not is_imm8(src)) {
+						unencodable(instr);
+					}
+
+					enc.reg_reg({ 0xC1 }, 5, reg_index(dst.reg));
+					enc.byte(static_cast<uint8_t>(src.imm));
+				} break;
+
+				case Opcode::Cmove: {
+					if (not is_reg(dst) or not is_reg(src)) {
+						unencodable(instr);
+					}
+
+					enc.reg_reg({ 0x0F, 0x44 }, reg_index(dst.reg), reg_index(src.reg));
+				} break;
+
+				case Opcode::Jmp: {
+					if (is_reg(dst)) {
+						enc.rex(false, 4, reg_index(dst.reg));
+						enc.byte(0xFF);
+						enc.modrm(4, reg_index(dst.reg));
+					}
+
+					else if (dst.kind == OperandKind::Label) {
+						enc.byte(0xE9);
+						enc.fixup(FixupKind::Rel32, dst.label);
+					}
+
+					else {
+						unencodable(instr);
+					}
+				} break;
+
+				case Opcode::Call: {
+					if (dst.kind != OperandKind::Label) {
+						unencodable(instr);
+					}
+
+					enc.byte(0xE8);
+					enc.fixup(FixupKind::Rel32, dst.label);
+				} break;
+
+				case Opcode::Ret: {
+					enc.byte(0xC3);
+				} break;
+
+				case Opcode::Syscall: {
+					enc.byte(0x0F);
+					enc.byte(0x05);
+				} break;
+			}
+		}
+	}  // namespace detail
+
+	// Encode `program` as if it were loaded at `base`. Only absolute label
+	// addresses depend on `base`, jumps and calls are relative.
+	inline Code encode(const Program& program, uint64_t base) {
+		Code code;
+		code.labels.assign(program.labels.size(), LABEL_UNPLACED);
+		code.bytes.reserve(program.instructions.size() * 4);
+
+		detail::Encoder enc { code };
+
+		for (const Instruction& instr: program.instructions) {
+			detail::encode_instruction(enc, instr);
+		}
+
+		for (auto [kind, offset, label]: enc.fixups) {
+			size_t target = code.labels[label];
+
+			if (target == LABEL_UNPLACED) {
+				fatal("label `", program.label_name(label), "` is never placed");
+			}
+
+			uint64_t value = kind == detail::FixupKind::Rel32 ? target - (offset + 4) : base + target;
+			size_t width = kind == detail::FixupKind::Rel32 ? 4 : 8;
+
+			for (size_t i = 0; i != width; ++i) {
+				code.bytes[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+			}
+		}
+
+		return code;
+	}
+}  // namespace deck::x86
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef DECK_MANAGER_HPP
+#define DECK_MANAGER_HPP
+
+/*
+	Runs the compiler's passes one after another and, when asked to,
+	records how long each one took, how much memory the process had used
+	by the end of it and how big its output was. Passes can also hand back
+	named counters (i.e. how often each peephole rule fired) which are
+	reported alongside.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <deck/deck.hpp>
+
+namespace deck {
+	// Named counts a pass reports about its own work.
+	using PassCounters = std::vector<std::pair<std::string_view, size_t>>;
+
+	struct PassStats {
+		std::string name;
+
+		double wall = 0.0;  // Milliseconds
+		double cpu = 0.0;   // Milliseconds
+
+		long rss = 0;       // Peak RSS of the process so far in KiB.
+		long rss_grew = 0;  // How much of that this pass added.
+
+		size_t nodes = 0;  // Symbols, instructions or bytes produced.
+
+		PassCounters counters;
+	};
+
+	namespace detail {
+		inline long peak_rss() {
+			struct rusage usage {};
+			::getrusage(RUSAGE_SELF, &usage);
+
+			return usage.ru_maxrss;
+		}
+
+		// Size of whatever a pass returned.
+		template <typename T>
+		inline size_t node_count(const T& x) {
+			if constexpr (requires { x.size(); }) {
+				return x.size();
+			}
+
+			else if constexpr (requires { x.instructions.size(); }) {
+				return x.instructions.size();
+			}
+
+			else if constexpr (requires { x.code.size(); }) {
+				return x.code.size();
+			}
+
+			else if constexpr (requires { x.view.size(); }) {
+				return x.view.size();
+			}
+
+			else {
+				return 0;
+			}
+		}
+	}  // namespace detail
+
+	struct PassManager {
+		bool timing = false;
+		std::vector<PassStats> stats;
+
+		// Filled in by the pass that is running and moved into its stats.
+		PassCounters counters;
+
+		// Where a pass should put its counters or `nullptr` if nobody will
+		// look at them.
+		PassCounters* sink() {
+			return timing ? &counters : nullptr;
+		}
+
+		// Runs `fn` and returns whatever it does.
+		template <typename F>
+		decltype(auto) run(std::string_view name, F&& fn) {
+			if (not timing) {
+				return fn();
+			}
+
+			using Clock = std::chrono::steady_clock;
+
+			long rss = detail::peak_rss();
+			std::clock_t cpu = std::clock();
+			auto wall = Clock::now();
+
+			decltype(auto) out = fn();
+
+			PassStats& s = stats.emplace_back();
+
+			s.name = name;
+			s.wall = std::chrono::duration<double, std::milli>(Clock::now() - wall).count();
+			s.cpu = 1000.0 * static_cast<double>(std::clock() - cpu) / CLOCKS_PER_SEC;
+			s.rss = detail::peak_rss();
+			s.rss_grew = s.rss - rss;
+			s.nodes = detail::node_count(out);
+			s.counters = std::exchange(counters, {});
+
+			return out;
+		}
+
+		double total_wall() const {
+			double total = 0.0;
+
+			for (const PassStats& s: stats) {
+				total += s.wall;
+			}
+
+			return total;
+		}
+
+		void report(std::ostream& os) const {
+			double total = total_wall();
+
+			println(os,
+				std::left, std::setw(12), "pass",
+				std::right, std::setw(12), "wall ms",
+				std::setw(12), "cpu ms",
+				std::setw(8), "%",
+				std::setw(12), "nodes",
+				std::setw(12), "rss KiB",
+				std::setw(12), "+rss KiB");
+
+			os << std::fixed << std::setprecision(3);
+
+			for (const PassStats& s: stats) {
+				println(os,
+					std::left, std::setw(12), s.name,
+					std::right, std::setw(12), s.wall,
+					std::setw(12), s.cpu,
+					std::setw(8), std::setprecision(1), total > 0.0 ? 100.0 * s.wall / total : 0.0, std::setprecision(3),
+					std::setw(12), s.nodes,
+					std::setw(12), s.rss,
+					std::setw(12), s.rss_grew);
+
+				for (const auto& [what, n]: s.counters) {
+					println(os, "  ", std::left, std::setw(22), what, std::right, std::setw(12), n);
+				}
+			}
+
+			println(os, std::left, std::setw(12), "total", std::right, std::setw(12), total);
+			os << std::defaultfloat;
+		}
+
+		void report_json(std::ostream& os) const {
+			println(os, "[");
+
+			for (size_t i = 0; i != stats.size(); ++i) {
+				const PassStats& s = stats[i];
+
+				print(os,
+					"\t{ \"pass\": \"", s.name,
+					"\", \"wall_ms\": ", s.wall,
+					", \"cpu_ms\": ", s.cpu,
+					", \"nodes\": ", s.nodes,
+					", \"rss_kib\": ", s.rss,
+					", \"rss_grew_kib\": ", s.rss_grew);
+
+				if (not s.counters.empty()) {
+					print(os, ", \"counters\": { ");
+
+					for (size_t j = 0; j != s.counters.size(); ++j) {
+						print(os, j == 0 ? "" : ", ", "\"", s.counters[j].first, "\": ", s.counters[j].second);
+					}
+
+					print(os, " }");
+				}
+
+				print(os, " }");
+
+				println(os, i + 1 == stats.size() ? "" : ",");
+			}
+
+			println(os, "]");
+		}
+	};
+}  // namespace deck
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef DECK_PASS_BYTECODE_HPP
+#define DECK_PASS_BYTECODE_HPP
+
+/*
+	Lower the tree to bytecode for the interpreter.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <algorithm>
+#include <vector>
+
+#include <deck/deck.hpp>
+#include <deck/bytecode.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// Labels and declarations are indexed by interned ID. Declared names
+		// that match a runtime builtin compile straight to its opcode,
+		// anything else declared has no definition we could run.
+		struct BytecodeEnv {
+			std::vector<bool> symbol_table;
+			std::vector<size_t> symbol_labels;
+			std::vector<size_t> builtins;  // Opcode of a declared builtin.
+			size_t last_push = SYMBOL_NONE;  // Offset of the last `Push` of a constant.
+
+			const Interner& interner;
+			bc::Program program;
+
+			BytecodeEnv(const Interner& interner_):
+					symbol_table(interner_.size(), false),
+					symbol_labels(interner_.size(), SYMBOL_NONE),
+					builtins(interner_.size(), SYMBOL_NONE),
+					interner(interner_) {
+				std::fill_n(symbol_table.begin(), PRIMITIVE_COUNT, true);
+			}
+
+			bool is_defined(size_t sym) const {
+				return symbol_table[sym];
+			}
+
+			// Returns false if the symbol was already defined.
+			bool define(size_t sym) {
+				if (symbol_table[sym]) {
+					return false;
+				}
+
+				symbol_table[sym] = true;
+				return true;
+			}
+
+			size_t label_of(size_t sym) {
+				if (symbol_labels[sym] == SYMBOL_NONE) {
+					symbol_labels[sym] = program.make_label();
+				}
+
+				return symbol_labels[sym];
+			}
+		};
+
+		// Arithmetic on a constant that was just pushed uses a single
+		// instruction with the constant as its operand.
+		constexpr bc::Opcode immediate_opcode(bc::Opcode x) {
+			switch (x) {
+				case bc::Opcode::Add: return bc::Opcode::AddImm;
+				case bc::Opcode::Sub: return bc::Opcode::SubImm;
+				case bc::Opcode::Mul: return bc::Opcode::MulImm;
+				default: return x;
+			}
+		}
+
+		constexpr bc::Opcode primitive_opcode(Primitive x) {
+			switch (x) {
+				case Primitive::Add: return bc::Opcode::Add;
+				case Primitive::Sub: return bc::Opcode::Sub;
+				case Primitive::Mul: return bc::Opcode::Mul;
+				case Primitive::Div: return bc::Opcode::Div;
+				case Primitive::Mod: return bc::Opcode::Mod;
+
+				case Primitive::Choose: return bc::Opcode::Choose;
+				case Primitive::Call: return bc::Opcode::Apply;
+
+				case Primitive::Pop: return bc::Opcode::Pop;
+				case Primitive::Dup: return bc::Opcode::Dup;
+				case Primitive::Count: return bc::Opcode::Count;
+				case Primitive::Clear: return bc::Opcode::Clear;
+			}
+
+			return bc::Opcode::Exit;
+		}
+	}  // namespace detail
+
+	inline void bytecode_impl(Tree& tree, Tree::iterator current, Tree::iterator& it, detail::BytecodeEnv& env) {
+		using bc::Opcode;
+
+		auto [str, kind, id] = *current;
+		bc::Program& program = env.program;
+
+		switch (kind) {
+			case SymbolKind::Header:
+			case SymbolKind::Footer: {
+				// `Exit` is emitted once after the whole tree.
+			} break;
+
+			// Literals
+			case SymbolKind::String:
+			case SymbolKind::Character: {
+			} break;
+
+			case SymbolKind::Integer: {
+				std::optional<uint64_t> value = parse_integer(str);
+
+				if (not value) {
+					fatal("`", str, "` is not a valid integer");
+				}
+
+				env.last_push = program.code.size();
+				program.emit(Opcode::Push, *value);
+			} break;
+
+			case SymbolKind::Identifier: {
+				if (not env.is_defined(id)) {
+					fatal("`", str, "` is not defined");
+				}
+
+				if (is_primitive(id)) {
+					Opcode op = detail::primitive_opcode(static_cast<Primitive>(id));
+					Opcode imm = detail::immediate_opcode(op);
+
+					size_t push = env.last_push;
+					bool fusable = push != SYMBOL_NONE and push >= program.fence and push + 2 == program.code.size();
+
+					if (imm != op and fusable) {
+						program.code[push] = static_cast<uint64_t>(imm);
+						env.last_push = SYMBOL_NONE;
+
+						break;
+					}
+
+					program.emit(op);
+					break;
+				}
+
+				if (env.builtins[id] != SYMBOL_NONE) {
+					program.emit(static_cast<Opcode>(env.builtins[id]));
+					break;
+				}
+
+				if (env.symbol_labels[id] == SYMBOL_NONE) {
+					fatal("`", str, "` is declared but has no definition");
+				}
+
+				program.emit_label(Opcode::Call, env.symbol_labels[id]);
+			} break;
+
+			// Definition and address
+			case SymbolKind::Declare: {
+			} break;
+
+			case SymbolKind::Label: {
+				program.place(env.label_of(id));
+			} break;
+
+			case SymbolKind::Address: {
+				if (not env.is_defined(id)) {
+					fatal("`", str, "` is not defined");
+				}
+
+				if (env.symbol_labels[id] == SYMBOL_NONE) {
+					fatal("cannot take the address of `", str, "`");
+				}
+
+				program.emit_label(Opcode::Push, env.symbol_labels[id]);
+			} break;
+
+			// Anonymous function
+			case SymbolKind::Quote: {
+				size_t quote = program.make_label();
+				size_t quote_end = program.make_label();
+
+				program.emit_label(Opcode::Jmp, quote_end);
+				program.place(quote);
+
+				it = visit_block(bytecode_impl, tree, it, env);
+
+				program.place(quote_end);
+				program.emit_label(Opcode::Push, quote);
+			} break;
+
+			// Stack frames
+			case SymbolKind::Frame: {
+				program.emit(Opcode::Enter);
+				it = visit_block(bytecode_impl, tree, it, env);
+				program.emit(Opcode::Leave);
+			} break;
+
+			case SymbolKind::End: break;
+
+			default: {
+				DECK_LOG(Priority::Warn, "unhandled symbol: `", kind, "`");
+			} break;
+		}
+	}
+
+	inline bc::Program bytecode(Tree&& tree) {
+		DECK_LOG(Priority::Okay);
+
+		detail::BytecodeEnv env { tree.interner };
+
+		// Definitions are collected up front so labels can be called before
+		// they appear.
+		for (Symbol sym: tree.symbols) {
+			if (eq_none(sym.kind, SymbolKind::Declare, SymbolKind::Label)) {
+				continue;
+			}
+
+			if (not env.define(sym.id)) {
+				fatal("`", sym.str, "` is declared already");
+			}
+
+			if (sym.kind == SymbolKind::Label) {
+				env.label_of(sym.id);
+				continue;
+			}
+
+			for (bc::Builtin builtin: bc::BUILTINS) {
+				if (builtin.name == sym.str) {
+					env.builtins[sym.id] = static_cast<size_t>(builtin.op);
+				}
+			}
+		}
+
+		pass(bytecode_impl, tree, env);
+
+		env.program.emit(bc::Opcode::Exit);
+		env.program.link();
+
+		DECK_LOG(Priority::Info, env.program.code.size(), " words");
+
+		return std::move(env.program);
+	}
+}  // namespace deck::passes
+
+#endif
@@ -16,8 +16,10 @@
 #include <deck/deck.hpp>
 
 namespace deck::passes {
-	inline void dumper_impl(Tree&, Tree::iterator current, Tree::iterator&) {
-		auto [str, kind] = *current;
+	// Writes one line per symbol so it can share a traversal with other
+	// passes that only read the tree.
+	inline void dump_symbol(std::ostream& os, Symbol sym) {
+		auto [str, kind, id] = sym;
 
 		switch (kind) {
 			case SymbolKind::String:  // Cases with associated string.
@@ -28,21 +30,21 @@ namespace deck::passes {
 			case SymbolKind::Declare:
 			case SymbolKind::Label:
 			case SymbolKind::Address: {
-				println(std::cerr, kind, " ", str, DECK_RESET);
+				println(os, kind, " ", str, DECK_RESET);
 			} break;
 
 			case SymbolKind::Header:  // No string data.
 			case SymbolKind::Footer: {
-				println(std::cerr, kind, DECK_RESET);
+				println(os, kind, DECK_RESET);
 			} break;
 
 			case SymbolKind::Quote:  // Blocks
 			case SymbolKind::Frame: {
-				println(std::cerr, kind, DECK_RESET);
+				println(os, kind, DECK_RESET);
 			} break;
 
 			case deck::SymbolKind::End: {
-				println(std::cerr, kind, DECK_RESET);
+				println(os, kind, DECK_RESET);
 			} break;
 
 			default: {
@@ -54,7 +56,10 @@ namespace deck::passes {
 	inline Tree dumper(Tree&& tree) {
 		DECK_LOG(Priority::Okay);
 
-		pass(dumper_impl, tree);
+		for (Symbol sym: tree.symbols) {
+			dump_symbol(std::cerr, sym);
+		}
+
 		return tree;
 	}
 }  // namespace deck::passes
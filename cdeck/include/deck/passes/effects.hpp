@@ -0,0 +1,413 @@
+#ifndef DECK_PASS_EFFECTS_HPP
+#define DECK_PASS_EFFECTS_HPP
+
+/*
+	Stack effect inference. Every label and quote is abstractly executed
+	to find how it changes the depth of the stack. The results are stored
+	in the tree for later passes and inconsistencies are rejected.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <optional>
+
+#include <deck/deck.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// How control leaves a block. `Return` means through `.` to the
+		// deepest value the block took from its caller which is usually the
+		// continuation. `Jump` is through an address we couldn't resolve
+		// that came from somewhere else.
+		enum class Exit {
+			Return,
+			Jump,
+			Fallthrough,
+		};
+
+		struct Inference {
+			Effect effect;
+			Exit exit;
+		};
+
+		enum class Status {
+			Unvisited,
+			Busy,  // Currently being inferred, used to detect recursion.
+			Unknown,
+			Known,
+		};
+
+		struct Memo {
+			Status status = Status::Unvisited;
+			Inference result {};
+		};
+
+		constexpr Effect primitive_effect(Primitive x) {
+			switch (x) {
+				case Primitive::Add:
+				case Primitive::Sub:
+				case Primitive::Mul:
+				case Primitive::Div:
+				case Primitive::Mod: return { 2, 1 };
+
+				case Primitive::Choose: return { 3, 1 };
+				case Primitive::Call: return { 1, 0 };
+
+				case Primitive::Pop: return { 1, 0 };
+				case Primitive::Dup: return { 1, 2 };
+				case Primitive::Count: return { 0, 1 };
+
+				default: return {};
+			}
+		}
+
+		// Abstract stack for a single block. Depths are relative to the
+		// stack on entry and `low` is the deepest point reached. Slots that
+		// hold the address of a label or quote remember its effect so that
+		// jumps through them can be followed.
+		struct Simulation {
+			using Value = std::optional<Inference>;
+
+			int64_t depth = 0;
+			int64_t low = 0;
+
+			std::vector<Value> values;
+
+			void push(Value v = std::nullopt) {
+				depth++;
+				values.push_back(v);
+			}
+
+			Value pop() {
+				depth--;
+				low = std::min(low, depth);
+
+				if (values.empty()) {
+					return std::nullopt;
+				}
+
+				Value v = values.back();
+				values.pop_back();
+
+				return v;
+			}
+
+			void apply(Effect e) {
+				for (size_t i = 0; i != e.in; ++i) {
+					pop();
+				}
+
+				for (size_t i = 0; i != e.out; ++i) {
+					push();
+				}
+			}
+
+			Effect effect() const {
+				return { static_cast<size_t>(-low), static_cast<size_t>(depth - low) };
+			}
+		};
+
+		// Jump through `target` from where `sim` is now. A block that
+		// returns through a value we know is followed on to it so that
+		// passing continuations around doesn't lose track of the stack.
+		inline std::optional<Inference> follow(Simulation& sim, Simulation::Value target) {
+			while (target) {
+				if (target->exit != Exit::Return) {
+					sim.apply(target->effect);
+					return Inference { sim.effect(), target->exit };
+				}
+
+				for (size_t i = 1; i < target->effect.in; ++i) {
+					sim.pop();
+				}
+
+				bool given = sim.values.empty();
+				target = sim.pop();
+
+				if (not target) {
+					return Inference { sim.effect(), given ? Exit::Return : Exit::Jump };
+				}
+			}
+
+			return std::nullopt;
+		}
+
+		struct EffectEnv {
+			Tree& tree;
+
+			std::vector<size_t> labels;  // Index of the definition by interned ID.
+
+			std::vector<Memo> label_memo;
+			std::vector<Memo> quote_memo;
+
+			EffectEnv(Tree& tree_):
+					tree(tree_),
+					labels(tree_.interner.size(), SYMBOL_NONE),
+					label_memo(tree_.interner.size()),
+					quote_memo(tree_.size()) {
+				for (size_t i = 0; i != tree.size(); ++i) {
+					if (tree.symbols.kinds[i] == SymbolKind::Label) {
+						labels[tree.symbols.spans[i].id] = i;
+					}
+				}
+			}
+		};
+
+		inline std::optional<Inference> infer_block(EffectEnv&, size_t);
+
+		template <typename F>
+		inline std::optional<Inference> memoize(Memo& memo, F&& fn) {
+			switch (memo.status) {
+				case Status::Known: return memo.result;
+				case Status::Busy:
+				case Status::Unknown: return std::nullopt;
+				default: break;
+			}
+
+			memo.status = Status::Busy;
+			std::optional<Inference> result = fn();
+
+			memo.status = result ? Status::Known : Status::Unknown;
+			memo.result = result.value_or(Inference {});
+
+			return result;
+		}
+
+		// Declarations without a body (i.e. externs) have no known effect.
+		inline std::optional<Inference> infer_label(EffectEnv& env, size_t id) {
+			if (env.labels[id] == SYMBOL_NONE) {
+				return std::nullopt;
+			}
+
+			return memoize(env.label_memo[id], [&] { return infer_block(env, env.labels[id] + 1); });
+		}
+
+		inline std::optional<Inference> infer_quote(EffectEnv& env, size_t i) {
+			return memoize(env.quote_memo[i], [&] { return infer_block(env, i + 1); });
+		}
+
+		// Run from `i` until control leaves the block. Falling into another
+		// label or jumping to a known address continues with its effect.
+		inline std::optional<Inference> infer_block(EffectEnv& env, size_t i) {
+			Simulation sim;
+
+			for (; i != env.tree.size(); ++i) {
+				auto [str, kind, id] = env.tree.symbols[i];
+
+				switch (kind) {
+					case SymbolKind::Integer: {
+						sim.push();
+					} break;
+
+					case SymbolKind::Address: {
+						sim.push(infer_label(env, id));
+					} break;
+
+					case SymbolKind::Quote: {
+						sim.push(infer_quote(env, i));
+						i = env.tree.symbols.end_of(i);
+					} break;
+
+					// Frames are checked on their own and must be balanced.
+					case SymbolKind::Frame: {
+						i = env.tree.symbols.end_of(i);
+					} break;
+
+					case SymbolKind::Label: {
+						return follow(sim, infer_label(env, id));
+					}
+
+					case SymbolKind::End:
+					case SymbolKind::Footer: {
+						return Inference { sim.effect(), Exit::Fallthrough };
+					}
+
+					case SymbolKind::Identifier: {
+						// Calls push a continuation and only come back if the
+						// callee returns through it. Callees that take more
+						// than that return through one of our values instead.
+						if (not is_primitive(id)) {
+							std::optional<Inference> callee = infer_label(env, id);
+
+							if (not callee or callee->exit != Exit::Return) {
+								return std::nullopt;
+							}
+
+							sim.push();
+
+							if (callee->effect.in != 1) {
+								return follow(sim, callee);
+							}
+
+							sim.apply(callee->effect);
+
+							break;
+						}
+
+						switch (static_cast<Primitive>(id)) {
+							case Primitive::Call: {
+								bool given = sim.values.empty();
+								Simulation::Value target = sim.pop();
+
+								if (not target) {
+									return Inference { sim.effect(), given ? Exit::Return : Exit::Jump };
+								}
+
+								return follow(sim, target);
+							}
+
+							case Primitive::Choose: {
+								Simulation::Value f = sim.pop();
+								Simulation::Value t = sim.pop();
+								sim.pop();
+
+								// Branches that leave through addresses we couldn't
+								// resolve may go different ways so only those that
+								// end up back at the same place are compared.
+								bool comparable = t and f and t->exit == f->exit and t->exit != Exit::Jump;
+
+								if (comparable and t->effect != f->effect) {
+									fatal("branches of `", str, "` have different stack effects: ", t->effect, " and ", f->effect);
+								}
+
+								sim.push(comparable ? t : std::nullopt);
+							} break;
+
+							// Nothing is known about the stack after this.
+							case Primitive::Clear: return std::nullopt;
+
+							default: {
+								sim.apply(primitive_effect(static_cast<Primitive>(id)));
+							} break;
+						}
+					} break;
+
+					// Strings and characters don't generate any code yet.
+					default: break;
+				}
+			}
+
+			return Inference { sim.effect(), Exit::Fallthrough };
+		}
+
+		// Index of the `.` ending the body of the label defined at `def` if
+		// the continuation is still on top of the stack when it's reached,
+		// i.e. the label always returns to whoever called it. Calls to
+		// other labels use the effects recorded by `passes::effects`.
+		inline std::optional<size_t> returning_call(const Tree& tree, size_t def) {
+			const Symbols& symbols = tree.symbols;
+			Simulation sim;
+
+			for (size_t i = def + 1; i != symbols.size(); ++i) {
+				auto [str, kind, id] = symbols[i];
+
+				switch (kind) {
+					case SymbolKind::Integer:
+					case SymbolKind::Address: {
+						sim.push();
+					} break;
+
+					case SymbolKind::Quote: {
+						sim.push();
+						i = symbols.end_of(i);
+					} break;
+
+					case SymbolKind::Frame: {
+						i = symbols.end_of(i);
+					} break;
+
+					case SymbolKind::Label:
+					case SymbolKind::Declare:
+					case SymbolKind::End:
+					case SymbolKind::Footer: return std::nullopt;
+
+					case SymbolKind::Identifier: {
+						if (not is_primitive(id)) {
+							auto effect = tree.label_effects.find(id);
+
+							if (effect == tree.label_effects.end()) {
+								return std::nullopt;
+							}
+
+							sim.push();
+							sim.apply(effect->second);
+
+							break;
+						}
+
+						switch (static_cast<Primitive>(id)) {
+							case Primitive::Call: {
+								if (sim.low == 0 and sim.depth == 0) {
+									return i;
+								}
+
+								return std::nullopt;
+							}
+
+							case Primitive::Clear: return std::nullopt;
+
+							default: {
+								sim.apply(primitive_effect(static_cast<Primitive>(id)));
+							} break;
+						}
+					} break;
+
+					default: break;
+				}
+			}
+
+			return std::nullopt;
+		}
+	}  // namespace detail
+
+	inline Tree effects(Tree&& tree) {
+		DECK_LOG(Priority::Okay);
+
+		detail::EffectEnv env { tree };
+
+		for (size_t i = 0; i != tree.size(); ++i) {
+			auto [str, kind, id] = tree.symbols[i];
+
+			switch (kind) {
+				// Top level code isn't recorded but still has to be checked.
+				case SymbolKind::Header: {
+					detail::infer_block(env, i + 1);
+				} break;
+
+				case SymbolKind::Label: {
+					if (auto inf = detail::infer_label(env, id)) {
+						tree.label_effects[id] = inf->effect;
+						DECK_LOG(Priority::Info, str, " ", inf->effect);
+					}
+				} break;
+
+				case SymbolKind::Quote: {
+					if (auto inf = detail::infer_quote(env, i)) {
+						tree.quote_effects[i] = inf->effect;
+					}
+				} break;
+
+				// The frame pointer is kept on top of the stack inside of a
+				// frame so anything that reaches below it or leaves values
+				// behind corrupts it.
+				case SymbolKind::Frame: {
+					auto inf = detail::infer_block(env, i + 1);
+
+					if (inf and inf->exit == detail::Exit::Fallthrough and inf->effect != Effect {}) {
+						fatal("stack frame is unbalanced: ", inf->effect);
+					}
+				} break;
+
+				default: break;
+			}
+		}
+
+		return tree;
+	}
+}  // namespace deck::passes
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef DECK_PASS_ELF_HPP
+#define DECK_PASS_ELF_HPP
+
+/*
+	Encode x86-64 instructions and write them out as a static ELF64
+	executable.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <cerrno>
+#include <cstring>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <deck/deck.hpp>
+#include <deck/x86.hpp>
+#include <deck/encoder.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// The whole file is mapped as a single read/execute segment at the
+		// usual base address for static executables. Code starts directly
+		// after the headers.
+		constexpr uint64_t ELF_BASE = 0x400000;
+		constexpr uint64_t ELF_CODE_OFFSET = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
+
+		inline void write_all(int fd, const void* data, size_t size) {
+			auto ptr = static_cast<const uint8_t*>(data);
+
+			while (size > 0) {
+				ssize_t n = ::write(fd, ptr, size);
+
+				if (n == -1) {
+					if (errno == EINTR) {
+						continue;
+					}
+
+					fatal("cannot write executable: ", std::strerror(errno));
+				}
+
+				ptr += n;
+				size -= n;
+			}
+		}
+
+		// Entry point is `_start` if there is one, otherwise the first byte.
+		inline uint64_t elf_entry(const x86::Program& program, const x86::Code& code) {
+			auto it = std::find(program.labels.begin(), program.labels.end(), "_start");
+
+			if (it == program.labels.end() or code.labels[it - program.labels.begin()] == x86::LABEL_UNPLACED) {
+				return ELF_BASE + ELF_CODE_OFFSET;
+			}
+
+			return ELF_BASE + ELF_CODE_OFFSET + code.labels[it - program.labels.begin()];
+		}
+	}  // namespace detail
+
+	inline x86::Program elf(x86::Program&& program, const char* path) {
+		DECK_LOG(Priority::Okay);
+
+		x86::Code code = x86::encode(program, detail::ELF_BASE + detail::ELF_CODE_OFFSET);
+		uint64_t size = detail::ELF_CODE_OFFSET + code.bytes.size();
+
+		Elf64_Ehdr ehdr {};
+
+		std::copy_n(ELFMAG, SELFMAG, ehdr.e_ident);
+		ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+		ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+		ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+		ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+
+		ehdr.e_type = ET_EXEC;
+		ehdr.e_machine = EM_X86_64;
+		ehdr.e_version = EV_CURRENT;
+		ehdr.e_entry = detail::elf_entry(program, code);
+		ehdr.e_phoff = sizeof(Elf64_Ehdr);
+		ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+		ehdr.e_phentsize = sizeof(Elf64_Phdr);
+		ehdr.e_phnum = 1;
+
+		Elf64_Phdr phdr {};
+
+		phdr.p_type = PT_LOAD;
+		phdr.p_flags = PF_R | PF_X;
+		phdr.p_offset = 0;
+		phdr.p_vaddr = detail::ELF_BASE;
+		phdr.p_paddr = detail::ELF_BASE;
+		phdr.p_filesz = size;
+		phdr.p_memsz = size;
+		phdr.p_align = 0x1000;
+
+		int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+
+		if (fd == -1) {
+			fatal("cannot open `", path, "`: ", std::strerror(errno));
+		}
+
+		detail::write_all(fd, &ehdr, sizeof(ehdr));
+		detail::write_all(fd, &phdr, sizeof(phdr));
+		detail::write_all(fd, code.bytes.data(), code.bytes.size());
+
+		// Writes can be deferred until the file is closed so errors might
+		// only show up here.
+		if (::close(fd) == -1) {
+			fatal("cannot write `", path, "`: ", std::strerror(errno));
+		}
+
+		DECK_LOG(Priority::Info, "wrote ", size, " bytes to `", path, "`");
+
+		return program;
+	}
+}  // namespace deck::passes
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef DECK_PASS_FOLD_HPP
+#define DECK_PASS_FOLD_HPP
+
+/*
+	Constant folding. Straight-line runs of integers and primitives are
+	evaluated at compile time and replaced by the integers they leave on
+	the stack.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+
+#include <deck/deck.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// A value known at compile time along with the symbol that produced
+		// it so that unfolded constants are emitted exactly as written.
+		struct Constant {
+			Symbol sym;
+			uint64_t value;
+		};
+
+		// Constants are held back in `pending` until something that can't
+		// be evaluated at compile time forces them out.
+		struct FoldEnv {
+			Symbols out;
+			std::vector<Constant> pending;
+
+			size_t folded = 0;
+
+			void flush() {
+				for (Constant& c: pending) {
+					out.push_back(c.sym);
+				}
+
+				pending.clear();
+			}
+
+			void emit(Symbol sym) {
+				flush();
+				out.push_back(sym);
+			}
+
+			uint64_t take() {
+				uint64_t value = pending.back().value;
+				pending.pop_back();
+
+				return value;
+			}
+		};
+
+		// Number of constants each primitive needs on top of the stack to be
+		// evaluated. Primitives that depend on runtime state are never folded
+		// and have an arity of 0.
+		constexpr size_t fold_arity(Primitive x) {
+			switch (x) {
+				case Primitive::Add:
+				case Primitive::Sub:
+				case Primitive::Mul:
+				case Primitive::Div:
+				case Primitive::Mod: return 2;
+
+				case Primitive::Choose: return 3;
+
+				case Primitive::Pop:
+				case Primitive::Dup: return 1;
+
+				default: return 0;
+			}
+		}
+	}  // namespace detail
+
+	// Binary operations follow the code generator and compute `top op second`.
+	// Division by zero is left for the runtime.
+	inline bool fold_primitive(Tree& tree, Primitive prim, detail::FoldEnv& env) {
+		size_t arity = detail::fold_arity(prim);
+
+		if (arity == 0 or env.pending.size() < arity) {
+			return false;
+		}
+
+		if (eq_any(prim, Primitive::Div, Primitive::Mod) and env.pending.rbegin()[1].value == 0) {
+			return false;
+		}
+
+		uint64_t result = 0;
+
+		switch (prim) {
+			case Primitive::Add: {
+				uint64_t top = env.take();
+				result = top + env.take();
+			} break;
+
+			case Primitive::Sub: {
+				uint64_t top = env.take();
+				result = top - env.take();
+			} break;
+
+			case Primitive::Mul: {
+				uint64_t top = env.take();
+				result = top * env.take();
+			} break;
+
+			case Primitive::Div: {
+				uint64_t top = env.take();
+				result = top / env.take();
+			} break;
+
+			case Primitive::Mod: {
+				uint64_t top = env.take();
+				result = top % env.take();
+			} break;
+
+			case Primitive::Choose: {
+				uint64_t f = env.take();
+				uint64_t t = env.take();
+				uint64_t cond = env.take();
+
+				result = cond == 1 ? t : f;
+			} break;
+
+			case Primitive::Pop: {
+				env.pending.pop_back();
+				return true;
+			}
+
+			case Primitive::Dup: {
+				env.pending.push_back(env.pending.back());
+				return true;
+			}
+
+			default: return false;
+		}
+
+		std::string_view str = tree.own(std::to_string(result));
+		env.pending.push_back({ Symbol { str, SymbolKind::Integer }, result });
+
+		return true;
+	}
+
+	inline void fold_impl(Tree& tree, Tree::iterator current, Tree::iterator&, detail::FoldEnv& env) {
+		Symbol sym = *current;
+
+		switch (sym.kind) {
+			case SymbolKind::Integer: {
+				if (auto value = parse_integer(sym.str)) {
+					env.pending.push_back({ sym, *value });
+					return;
+				}
+
+				env.emit(sym);
+			} break;
+
+			case SymbolKind::Identifier: {
+				if (is_primitive(sym.id) and fold_primitive(tree, static_cast<Primitive>(sym.id), env)) {
+					env.folded++;
+					return;
+				}
+
+				env.emit(sym);
+			} break;
+
+			// Labels, blocks and anything else end the straight-line region.
+			default: {
+				env.emit(sym);
+			} break;
+		}
+	}
+
+	inline Tree fold(Tree&& tree) {
+		DECK_LOG(Priority::Okay);
+
+		detail::FoldEnv env;
+		env.out.reserve(tree.size());
+
+		pass(fold_impl, tree, env);
+		env.flush();
+
+		DECK_LOG(Priority::Info, "folded ", env.folded, " primitives, ", tree.size(), " -> ", env.out.size(), " symbols");
+
+		// Quote effects are keyed by index which folding shifts around.
+		tree.symbols = std::move(env.out);
+		tree.quote_effects.clear();
+
+		return tree;
+	}
+}  // namespace deck::passes
+
+#endif
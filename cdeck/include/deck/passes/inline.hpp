@@ -0,0 +1,294 @@
+#ifndef DECK_PASS_INLINE_HPP
+#define DECK_PASS_INLINE_HPP
+
+/*
+	Inline expansion of small labels at their call sites.
+	Must run after `passes::effects`.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+#include <string>
+#include <optional>
+#include <unordered_map>
+
+#include <deck/deck.hpp>
+#include <deck/passes/effects.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// Maximum number of symbols in a body, including nested blocks.
+		constexpr size_t INLINE_THRESHOLD = 8;
+
+		// Body of a label up to (but not including) the `.` it returns
+		// through. When `returns` is set we know the body leaves the
+		// continuation untouched on top of the stack so the call and the
+		// return can both be dropped.
+		struct InlineBody {
+			size_t begin;
+			size_t end;
+
+			bool returns;
+		};
+
+		struct InlineEnv {
+			Tree& tree;
+
+			std::vector<Memo> memo;  // `Memo::status` only, by interned ID.
+			std::vector<InlineBody> bodies;
+
+			std::vector<size_t> labels;  // Index of the definition by interned ID.
+			std::vector<bool> address_taken;
+			std::vector<bool> expanding;
+
+			Symbols out;
+			std::unordered_map<size_t, Effect> quote_effects;
+
+			size_t id = 0;
+			size_t inlined = 0;
+
+			InlineEnv(Tree& tree_):
+					tree(tree_),
+					memo(tree_.interner.size()),
+					bodies(tree_.interner.size()),
+					labels(tree_.interner.size(), SYMBOL_NONE),
+					address_taken(tree_.interner.size(), false),
+					expanding(tree_.interner.size(), false) {
+				for (size_t i = 0; i != tree.size(); ++i) {
+					SymbolKind kind = tree.symbols.kinds[i];
+
+					if (kind == SymbolKind::Label) {
+						labels[tree.symbols.spans[i].id] = i;
+					}
+
+					else if (kind == SymbolKind::Address) {
+						address_taken[tree.symbols.spans[i].id] = true;
+					}
+				}
+			}
+		};
+
+		inline std::optional<InlineBody> inline_body(InlineEnv&, size_t);
+
+		// Find the body of the label defined at `def` and check that it's
+		// small, straight-line code which doesn't refer to itself.
+		inline std::optional<InlineBody> inline_scan(InlineEnv& env, size_t def) {
+			const Symbols& symbols = env.tree.symbols;
+			size_t self = symbols[def].id;
+
+			size_t nesting = 0;
+			size_t i = def + 1;
+
+			for (; i != symbols.size(); ++i) {
+				auto [str, kind, id] = symbols[i];
+
+				if (i - def > INLINE_THRESHOLD) {
+					return std::nullopt;
+				}
+
+				switch (kind) {
+					case SymbolKind::Quote:
+					case SymbolKind::Frame: {
+						nesting++;
+					} continue;
+
+					case SymbolKind::End: {
+						if (nesting == 0) {
+							return std::nullopt;
+						}
+
+						nesting--;
+					} continue;
+
+					case SymbolKind::Label:
+					case SymbolKind::Declare:
+					case SymbolKind::Footer: return std::nullopt;
+
+					case SymbolKind::Identifier: {
+						// The stack depth changes when inlined so anything that
+						// looks at it has to stay behind a real call.
+						bool inspects_stack = eq_any(
+							id, static_cast<size_t>(Primitive::Count), static_cast<size_t>(Primitive::Clear));
+
+						if (id == self or inspects_stack) {
+							return std::nullopt;
+						}
+					} break;
+
+					default: break;
+				}
+
+				if (nesting == 0 and kind == SymbolKind::Identifier and id == static_cast<size_t>(Primitive::Call)) {
+					break;
+				}
+			}
+
+			if (i == symbols.size()) {
+				return std::nullopt;
+			}
+
+			// Work out if the continuation is on top when we reach the `.`.
+			// Calls only count if they are themselves inlined without a
+			// return since anything else might inspect the stack.
+			Simulation sim;
+			bool returns = true;
+
+			for (size_t j = def + 1; j != i; ++j) {
+				auto [str, kind, id] = symbols[j];
+
+				switch (kind) {
+					case SymbolKind::Integer:
+					case SymbolKind::Address: {
+						sim.push();
+					} break;
+
+					// Frames are balanced so only quotes have an effect here.
+					case SymbolKind::Quote: {
+						sim.push();
+						j = symbols.end_of(j);
+					} break;
+
+					case SymbolKind::Frame: {
+						j = symbols.end_of(j);
+					} break;
+
+					case SymbolKind::Identifier: {
+						if (is_primitive(id)) {
+							sim.apply(primitive_effect(static_cast<Primitive>(id)));
+							break;
+						}
+
+						auto callee = inline_body(env, id);
+						auto effect = env.tree.label_effects.find(id);
+
+						if (not callee or not callee->returns or effect == env.tree.label_effects.end()) {
+							returns = false;
+							break;
+						}
+
+						sim.push();
+						sim.apply(effect->second);
+					} break;
+
+					default: break;
+				}
+			}
+
+			returns = returns and sim.low == 0 and sim.depth == 0;
+
+			return InlineBody { def + 1, i, returns };
+		}
+
+		inline std::optional<InlineBody> inline_body(InlineEnv& env, size_t id) {
+			Memo& memo = env.memo[id];
+
+			switch (memo.status) {
+				case Status::Known: return env.bodies[id];
+				case Status::Busy:
+				case Status::Unknown: return std::nullopt;
+				default: break;
+			}
+
+			if (env.labels[id] == SYMBOL_NONE or env.address_taken[id]) {
+				memo.status = Status::Unknown;
+				return std::nullopt;
+			}
+
+			memo.status = Status::Busy;
+			std::optional<InlineBody> body = inline_scan(env, env.labels[id]);
+
+			memo.status = body ? Status::Known : Status::Unknown;
+
+			if (body) {
+				env.bodies[id] = *body;
+			}
+
+			return body;
+		}
+
+		inline void inline_copy(InlineEnv& env, size_t i) {
+			// Only quotes have an effect recorded against their index.
+			if (env.tree.symbols.kinds[i] == SymbolKind::Quote) {
+				auto effect = env.tree.quote_effects.find(i);
+
+				if (effect != env.tree.quote_effects.end()) {
+					env.quote_effects[env.out.size()] = effect->second;
+				}
+			}
+
+			env.out.push_back(env.tree.symbols[i]);
+		}
+
+		inline void inline_range(InlineEnv&, size_t, size_t);
+
+		// Splice the body of `id` in place of a call to it. Bodies that don't
+		// return cleanly get an explicit continuation placed right after.
+		inline bool inline_call(InlineEnv& env, size_t id) {
+			if (is_primitive(id) or env.expanding[id]) {
+				return false;
+			}
+
+			std::optional<InlineBody> body = inline_body(env, id);
+
+			if (not body) {
+				return false;
+			}
+
+			env.inlined++;
+			env.expanding[id] = true;
+
+			if (body->returns) {
+				inline_range(env, body->begin, body->end);
+			}
+
+			else {
+				std::string_view name = env.tree.own("__inline_" + std::to_string(env.id++));
+				size_t ret = env.tree.interner.intern(name);
+
+				env.out.emplace_back(name, SymbolKind::Address, ret);
+				inline_range(env, body->begin, body->end);
+				env.out.emplace_back(".", SymbolKind::Identifier, static_cast<size_t>(Primitive::Call));
+				env.out.emplace_back(name, SymbolKind::Label, ret);
+			}
+
+			env.expanding[id] = false;
+
+			return true;
+		}
+
+		inline void inline_range(InlineEnv& env, size_t begin, size_t end) {
+			for (size_t i = begin; i != end; ++i) {
+				Symbol sym = env.tree.symbols[i];
+
+				if (sym.kind == SymbolKind::Identifier and inline_call(env, sym.id)) {
+					continue;
+				}
+
+				inline_copy(env, i);
+			}
+		}
+	}  // namespace detail
+
+	inline Tree inliner(Tree&& tree) {
+		DECK_LOG(Priority::Okay);
+
+		detail::InlineEnv env { tree };
+		env.out.reserve(tree.size());
+
+		detail::inline_range(env, 0, tree.size());
+
+		DECK_LOG(Priority::Info, "inlined ", env.inlined, " calls");
+
+		// The interner may have grown but IDs are stable so label effects
+		// carry over as they are.
+		tree.symbols = std::move(env.out);
+		tree.quote_effects = std::move(env.quote_effects);
+
+		return tree;
+	}
+}  // namespace deck::passes
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef DECK_PASS_INTERP_HPP
+#define DECK_PASS_INTERP_HPP
+
+/*
+	Run bytecode without generating any machine code. Values live on a
+	stack laid out the same way as the native one, with the top cached in
+	a local just like `rax`, so `#`, frames and `clear` behave the same.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+#include <deck/deck.hpp>
+#include <deck/bytecode.hpp>
+
+// Computed goto is a GNU extension. Elsewhere we fall back to a switch.
+#if defined(__GNUC__) and not defined(DECK_INTERP_NO_THREADING)
+#define DECK_INTERP_THREADED
+#endif
+
+namespace deck::passes {
+	namespace detail {
+		constexpr size_t INTERP_STACK_SIZE = (1 << 20) / sizeof(uint64_t);
+
+		// Threaded code replaces every opcode word with the address of its
+		// handler. Operand words are copied as they are.
+		union Cell {
+			const void* handler;
+			uint64_t value;
+		};
+
+		// Only labels, quotes and return addresses can be jumped to
+		// indirectly. Anything else would land on an operand.
+		inline std::vector<uint8_t> interp_targets(const bc::Program& program) {
+			std::vector<uint8_t> targets(program.code.size() + 1, false);
+
+			for (size_t label: program.labels) {
+				if (label != SYMBOL_NONE) {
+					targets[label] = true;
+				}
+			}
+
+			bc::for_each(program, [&](size_t offset, bc::Opcode op) {
+				if (op == bc::Opcode::Call) {
+					targets[offset + 2] = true;
+				}
+			});
+
+			return targets;
+		}
+	}  // namespace detail
+
+#if defined(DECK_INTERP_THREADED)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+	// Returns the top of the stack when the program finishes.
+	inline uint64_t interp(bc::Program&& program) {
+		DECK_LOG(Priority::Okay);
+
+		using bc::Opcode;
+		using detail::Cell;
+
+		std::vector<Cell> code(program.code.size());
+		std::vector<uint8_t> targets = detail::interp_targets(program);
+
+#if defined(DECK_INTERP_THREADED)
+#define X(a, b, c) &&op_##a,
+		static const void* const HANDLERS[] = { BYTECODES };
+#undef X
+
+		bc::for_each(program, [&](size_t offset, Opcode op) {
+			code[offset].handler = HANDLERS[static_cast<size_t>(op)];
+
+			for (size_t i = 1; i <= bc::operand_count(op); ++i) {
+				code[offset + i].value = program.code[offset + i];
+			}
+		});
+#else
+		for (size_t i = 0; i != code.size(); ++i) {
+			code[i].value = program.code[i];
+		}
+#endif
+
+		std::vector<uint64_t> stack(detail::INTERP_STACK_SIZE);
+		std::vector<uint64_t> deque;
+
+		uint64_t* const base = stack.data();
+		uint64_t* const top = base + stack.size();
+
+		// Same as the native prologue: `tos` starts out as garbage that is
+		// pushed to the first slot, which `#` doesn't count.
+		uint64_t* sp = top;
+		uint64_t* bp = top - 1;
+		uint64_t tos = 0;
+
+		const Cell* ip = code.data();
+
+		auto jump = [&](uint64_t target) {
+			if (target >= code.size() or not targets[target]) {
+				fatal("invalid jump to ", target);
+			}
+
+			ip = code.data() + target;
+		};
+
+#define DECK_PUSH(x) \
+	do { \
+		if (sp == base) { \
+			fatal("stack overflow"); \
+		} \
+		*--sp = (x); \
+	} while (0)
+
+#define DECK_POP() (sp == top ? (fatal("stack underflow"), 0) : *sp++)
+
+#if defined(DECK_INTERP_THREADED)
+#define DECK_OP(x)   op_##x
+#define DECK_NEXT()  goto*(ip++)->handler
+#define DECK_FINISH()
+
+		DECK_NEXT();
+#else
+#define DECK_OP(x)   case Opcode::x
+#define DECK_NEXT()  continue
+#define DECK_FINISH() }
+
+		for (;;) switch (static_cast<Opcode>((ip++)->value)) {
+#endif
+			DECK_OP(Push): {
+				DECK_PUSH(tos);
+				tos = (ip++)->value;
+			} DECK_NEXT();
+
+			DECK_OP(Jmp): {
+				ip = code.data() + ip->value;
+			} DECK_NEXT();
+
+			// Push the continuation like a native call does.
+			DECK_OP(Call): {
+				DECK_PUSH(tos);
+				tos = ip - code.data() + 1;
+				ip = code.data() + ip->value;
+			} DECK_NEXT();
+
+			DECK_OP(Apply): {
+				uint64_t target = tos;
+				tos = DECK_POP();
+				jump(target);
+			} DECK_NEXT();
+
+			DECK_OP(Exit): {
+				DECK_LOG(Priority::Info, "finished with ", top - sp, " words on the stack");
+				return tos;
+			} DECK_NEXT();
+
+			// Arithmetic is computed as `top op second`.
+			DECK_OP(Add): {
+				tos += DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(Sub): {
+				tos -= DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(Mul): {
+				tos *= DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(Div): {
+				uint64_t rhs = DECK_POP();
+
+				if (rhs == 0) {
+					fatal("division by zero");
+				}
+
+				tos /= rhs;
+			} DECK_NEXT();
+
+			DECK_OP(Mod): {
+				uint64_t rhs = DECK_POP();
+
+				if (rhs == 0) {
+					fatal("division by zero");
+				}
+
+				tos %= rhs;
+			} DECK_NEXT();
+
+			// The operand is the constant that would have been on top.
+			DECK_OP(AddImm): {
+				tos += (ip++)->value;
+			} DECK_NEXT();
+
+			DECK_OP(SubImm): {
+				tos = (ip++)->value - tos;
+			} DECK_NEXT();
+
+			DECK_OP(MulImm): {
+				tos *= (ip++)->value;
+			} DECK_NEXT();
+
+			DECK_OP(Choose): {
+				uint64_t t = DECK_POP();
+				uint64_t cond = DECK_POP();
+
+				tos = cond == 1 ? t : tos;
+			} DECK_NEXT();
+
+			// Stack manipulation
+			DECK_OP(Pop): {
+				tos = DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(Dup): {
+				DECK_PUSH(tos);
+			} DECK_NEXT();
+
+			DECK_OP(Count): {
+				DECK_PUSH(tos);
+				tos = bp - sp;
+			} DECK_NEXT();
+
+			DECK_OP(Clear): {
+				sp = bp;
+			} DECK_NEXT();
+
+			// The old base is kept in the top slot for the duration of the
+			// frame. We store it as an offset so a stray value can be checked.
+			DECK_OP(Enter): {
+				DECK_PUSH(tos);
+				tos = bp - base;
+				bp = sp;
+			} DECK_NEXT();
+
+			DECK_OP(Leave): {
+				if (tos >= stack.size()) {
+					fatal("frame base was overwritten");
+				}
+
+				bp = base + tos;
+				tos = DECK_POP();
+			} DECK_NEXT();
+
+			// Builtins. Indices count down from the slot below the top.
+			DECK_OP(Get): {
+				if (tos >= static_cast<uint64_t>(top - sp)) {
+					fatal("`get` index ", tos, " out of range");
+				}
+
+				tos = sp[tos];
+			} DECK_NEXT();
+
+			DECK_OP(Set): {
+				uint64_t i = tos;
+				uint64_t x = DECK_POP();
+
+				tos = DECK_POP();
+
+				if (i >= static_cast<uint64_t>(top - sp) + 1) {
+					fatal("`set` index ", i, " out of range");
+				}
+
+				if (i == 0) {
+					tos = x;
+				}
+
+				else {
+					sp[i - 1] = x;
+				}
+			} DECK_NEXT();
+
+			DECK_OP(Mget): {
+				tos = *reinterpret_cast<const uint64_t*>(tos);
+			} DECK_NEXT();
+
+			DECK_OP(Mset): {
+				uint64_t* addr = reinterpret_cast<uint64_t*>(tos);
+				*addr = DECK_POP();
+				tos = DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(DequePush): {
+				deque.push_back(tos);
+				tos = DECK_POP();
+			} DECK_NEXT();
+
+			DECK_OP(DequePop): {
+				if (deque.empty()) {
+					fatal("deque is empty");
+				}
+
+				DECK_PUSH(tos);
+				tos = deque.back();
+				deque.pop_back();
+			} DECK_NEXT();
+		DECK_FINISH()
+
+#undef DECK_PUSH
+#undef DECK_POP
+#undef DECK_OP
+#undef DECK_NEXT
+#undef DECK_FINISH
+	}
+
+#if defined(DECK_INTERP_THREADED)
+#pragma GCC diagnostic pop
+#endif
+}  // namespace deck::passes
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef DECK_PASS_JIT_HPP
+#define DECK_PASS_JIT_HPP
+
+/*
+	Encode x86-64 instructions into executable memory and run them
+	in-process. Expects code generated with `X86Options::jit`.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <deck/deck.hpp>
+#include <deck/x86.hpp>
+#include <deck/encoder.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		constexpr size_t JIT_STACK_SIZE = 1 << 20;
+
+		inline size_t find_label(const x86::Program& program, std::string_view name) {
+			auto it = std::find(program.labels.begin(), program.labels.end(), name);
+
+			if (it == program.labels.end()) {
+				fatal("missing label `", name, "`");
+			}
+
+			return it - program.labels.begin();
+		}
+
+		// Called from C++ as `uint64_t(void* stack)`. Saves the callee saved
+		// registers, switches to the Deck stack and jumps to `_start`. The
+		// generated code comes back through `__exit` with its status in `rax`.
+		// Deck code never touches `r15` so the host stack pointer lives there.
+		inline void jit_trampoline(x86::Program& program) {
+			using namespace x86;
+
+			constexpr std::array SAVED {
+				Register::Rbx, Register::Rbp, Register::R12, Register::R13, Register::R14, Register::R15,
+			};
+
+			program.emit(Opcode::Label, label(program.make_label("__enter")));
+
+			for (Register r: SAVED) {
+				program.emit(Opcode::Push, reg(r));
+			}
+
+			program.emit(Opcode::Mov, reg(Register::R15), reg(Register::Rsp));
+			program.emit(Opcode::Mov, reg(Register::Rsp), reg(Register::Rdi));
+			program.emit(Opcode::Jmp, label(find_label(program, "_start")));
+
+			program.emit(Opcode::Label, label(find_label(program, "__exit")));
+			program.emit(Opcode::Mov, reg(Register::Rsp), reg(Register::R15));
+
+			for (auto it = SAVED.rbegin(); it != SAVED.rend(); ++it) {
+				program.emit(Opcode::Pop, reg(*it));
+			}
+
+			program.emit(Opcode::Ret);
+		}
+
+		inline void* jit_map(size_t size, int prot) {
+			void* ptr = ::mmap(nullptr, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (ptr == MAP_FAILED) {
+				fatal("cannot map memory: ", std::strerror(errno));
+			}
+
+			return ptr;
+		}
+	}  // namespace detail
+
+	// Returns the top of the stack when the program finishes.
+	inline uint64_t jit(x86::Program&& program) {
+		DECK_LOG(Priority::Okay);
+
+		detail::jit_trampoline(program);
+
+		// Code size doesn't depend on the base address so we encode once to
+		// find out how much memory we need and again once we know where it is.
+		size_t size = x86::encode(program, 0).bytes.size();
+		auto code_ptr = static_cast<uint8_t*>(detail::jit_map(size, PROT_READ | PROT_WRITE));
+
+		x86::Code code = x86::encode(program, reinterpret_cast<uint64_t>(code_ptr));
+		std::copy(code.bytes.begin(), code.bytes.end(), code_ptr);
+
+		if (::mprotect(code_ptr, size, PROT_READ | PROT_EXEC) == -1) {
+			fatal("cannot make code executable: ", std::strerror(errno));
+		}
+
+		// The stack grows down so an inaccessible page below it turns an
+		// overflow into a fault rather than silently scribbling over
+		// whatever was mapped there.
+		size_t guard = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		size_t mapped = guard + detail::JIT_STACK_SIZE;
+
+		auto stack_ptr = static_cast<uint8_t*>(detail::jit_map(mapped, PROT_READ | PROT_WRITE));
+
+		if (::mprotect(stack_ptr, guard, PROT_NONE) == -1) {
+			fatal("cannot protect stack guard page: ", std::strerror(errno));
+		}
+
+		using Entry = uint64_t (*)(void*);
+		auto entry = reinterpret_cast<Entry>(code_ptr + code.labels[detail::find_label(program, "__enter")]);
+
+		DECK_LOG(Priority::Info, "running ", size, " bytes");
+		uint64_t status = entry(stack_ptr + mapped);
+
+		::munmap(stack_ptr, mapped);
+		::munmap(code_ptr, size);
+
+		return status;
+	}
+}  // namespace deck::passes
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef DECK_PASS_NASM_HPP
+#define DECK_PASS_NASM_HPP
+
+/*
+	Print x86-64 instructions as NASM assembly.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <string_view>
+#include <type_traits>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <deck/deck.hpp>
+#include <deck/x86.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		// Assembly is formatted into one contiguous buffer and handed to the
+		// kernel in large chunks rather than going through `std::cout` for
+		// every line.
+		struct Emitter {
+			static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+			fmt::memory_buffer buf;
+			int fd;
+
+			Emitter(int fd_ = STDOUT_FILENO): fd(fd_) {
+				buf.reserve(CHUNK_SIZE * 2);
+			}
+
+			template <typename T>
+			void append(T&& x) {
+				if constexpr (std::is_convertible_v<T, std::string_view>) {
+					std::string_view sv = x;
+					buf.append(sv.data(), sv.data() + sv.size());
+				}
+
+				else {
+					fmt::format_to(fmt::appender(buf), "{}", std::forward<T>(x));
+				}
+			}
+
+			template <typename... Ts>
+			void line(Ts&&... args) {
+				(append(std::forward<Ts>(args)), ...);
+				buf.push_back('\n');
+
+				if (buf.size() >= CHUNK_SIZE) {
+					flush();
+				}
+			}
+
+			void flush() {
+				const char* ptr = buf.data();
+				size_t size = buf.size();
+
+				while (size > 0) {
+					ssize_t n = ::write(fd, ptr, size);
+
+					if (n == -1) {
+						if (errno == EINTR) {
+							continue;
+						}
+
+						fatal("cannot write assembly: ", std::strerror(errno));
+					}
+
+					ptr += n;
+					size -= n;
+				}
+
+				buf.clear();
+			}
+		};
+
+		inline void nasm_operand(Emitter& out, const x86::Program& program, x86::Operand x) {
+			switch (x.kind) {
+				case x86::OperandKind::Reg: out.append(x86::reg_to_str(x.reg)); break;
+				case x86::OperandKind::Imm: out.append(x.imm); break;
+				case x86::OperandKind::Label: out.append(program.label_name(x.label)); break;
+				case x86::OperandKind::None: break;
+			}
+		}
+	}  // namespace detail
+
+	inline x86::Program nasm(x86::Program&& program) {
+		DECK_LOG(Priority::Okay);
+
+		detail::Emitter out;
+
+		out.line("section .text");
+		out.line("global _start");
+
+		for (const x86::Instruction& instr: program.instructions) {
+			if (instr.op == x86::Opcode::Label) {
+				out.line(program.label_name(instr.dst.label), ":");
+				continue;
+			}
+
+			out.append("  ");
+			out.append(x86::opcode_to_str(instr.op));
+
+			if (instr.dst.kind != x86::OperandKind::None) {
+				out.append(" ");
+				detail::nasm_operand(out, program, instr.dst);
+			}
+
+			if (instr.src.kind != x86::OperandKind::None) {
+				out.append(", ");
+				detail::nasm_operand(out, program, instr.src);
+			}
+
+			out.line();
+		}
+
+		out.flush();
+
+		return program;
+	}
+}  // namespace deck::passes
+
+#endif
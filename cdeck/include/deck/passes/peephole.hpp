@@ -0,0 +1,401 @@
+#ifndef DECK_PASS_PEEPHOLE_HPP
+#define DECK_PASS_PEEPHOLE_HPP
+
+/*
+	Table driven peephole optimiser over x86-64 instructions.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <array>
+#include <vector>
+
+#include <deck/deck.hpp>
+#include <deck/manager.hpp>
+#include <deck/x86.hpp>
+
+namespace deck::passes {
+	namespace detail {
+		constexpr uint32_t reg_bit(x86::Register r) {
+			return 1u << static_cast<size_t>(r);
+		}
+
+		constexpr uint32_t operand_bit(x86::Operand x) {
+			return x86::is_reg(x) ? reg_bit(x.reg) : 0;
+		}
+
+		// Registers that carry a value across labels and jumps. Everything
+		// else is scratch at block boundaries in the code we generate.
+		constexpr uint32_t LIVE_AT_BOUNDARY =
+			reg_bit(x86::Register::Rax) | reg_bit(x86::Register::Rsp) | reg_bit(x86::Register::Rbp);
+
+		struct Effects {
+			uint32_t reads = 0;
+			uint32_t writes = 0;
+
+			bool reads_flags = false;
+			bool writes_flags = false;
+
+			bool boundary = false;  // Control flow enters or leaves here.
+		};
+
+		inline Effects effects(const x86::Instruction& instr) {
+			using namespace x86;
+
+			Effects e;
+
+			uint32_t dst = operand_bit(instr.dst);
+			uint32_t src = operand_bit(instr.src);
+			uint32_t rsp = reg_bit(Register::Rsp);
+
+			switch (instr.op) {
+				case Opcode::Label: {
+					e.boundary = true;
+				} break;
+
+				case Opcode::Jmp: {
+					e.reads = dst;
+					e.boundary = true;
+				} break;
+
+				case Opcode::Call:
+				case Opcode::Ret: {
+					e.reads = dst | rsp;
+					e.writes = rsp;
+					e.boundary = true;
+				} break;
+
+				// Only `exit` is used for now but treat it as a barrier all
+				// the same.
+				case Opcode::Syscall: {
+					e.reads = reg_bit(Register::Rax) | reg_bit(Register::Rdi) | reg_bit(Register::Rsi) |
+						reg_bit(Register::Rdx);
+					e.writes = reg_bit(Register::Rax) | reg_bit(Register::Rcx) | reg_bit(Register::R11);
+					e.boundary = true;
+				} break;
+
+				case Opcode::Mov: {
+					e.reads = src;
+					e.writes = dst;
+				} break;
+
+				case Opcode::Push: {
+					e.reads = dst | rsp;
+					e.writes = rsp;
+				} break;
+
+				case Opcode::Pop: {
+					e.reads = rsp;
+					e.writes = dst | rsp;
+				} break;
+
+				case Opcode::Add:
+				case Opcode::Sub:
+				case Opcode::Imul:
+				case Opcode::Xor:
+				case Opcode::Shr: {
+					e.reads = dst | src;
+					e.writes = dst;
+					e.writes_flags = true;
+				} break;
+
+				case Opcode::Div: {
+					uint32_t rax_rdx = reg_bit(Register::Rax) | reg_bit(Register::Rdx);
+
+					e.reads = dst | rax_rdx;
+					e.writes = rax_rdx;
+					e.writes_flags = true;
+				} break;
+
+				case Opcode::Cmp: {
+					e.reads = dst | src;
+					e.writes_flags = true;
+				} break;
+
+				case Opcode::Cmove: {
+					e.reads = dst | src;
+					e.writes = dst;
+					e.reads_flags = true;
+				} break;
+			}
+
+			return e;
+		}
+
+		using Iter = const x86::Instruction*;
+
+		// Is the value in `r` overwritten before anything reads it?
+		inline bool is_dead(Iter it, Iter end, x86::Register r) {
+			uint32_t bit = reg_bit(r);
+
+			for (; it != end; ++it) {
+				Effects e = effects(*it);
+
+				if (e.reads & bit) {
+					return false;
+				}
+
+				if (e.writes & bit) {
+					return true;
+				}
+
+				if (e.boundary) {
+					break;
+				}
+			}
+
+			return not(LIVE_AT_BOUNDARY & bit);
+		}
+
+		inline bool flags_dead(Iter it, Iter end) {
+			for (; it != end; ++it) {
+				Effects e = effects(*it);
+
+				if (e.reads_flags) {
+					return false;
+				}
+
+				if (e.writes_flags or e.boundary) {
+					return true;
+				}
+			}
+
+			return true;
+		}
+
+		inline bool touches(const x86::Instruction& instr, x86::Register r) {
+			Effects e = effects(instr);
+			return ((e.reads | e.writes) & reg_bit(r)) or e.boundary;
+		}
+
+		constexpr size_t PEEPHOLE_LOOKAHEAD = 6;
+
+		// A rule looks at the instructions starting at `it` and returns how
+		// many of them it consumed, appending any replacements to `out`.
+		// Returning 0 means the rule didn't match.
+		using PeepholeFn = size_t (*)(std::vector<x86::Instruction>& out, Iter it, Iter end);
+
+		struct PeepholeRule {
+			const char* name;
+			PeepholeFn fn;
+		};
+
+		// push x; pop r => mov r, x
+		inline size_t peephole_push_pop(std::vector<x86::Instruction>& out, Iter it, Iter end) {
+			using namespace x86;
+
+			if (end - it < 2 or it[0].op != Opcode::Push or it[1].op != Opcode::Pop) {
+				return 0;
+			}
+
+			if (it[0].dst != it[1].dst) {
+				out.push_back({ Opcode::Mov, it[1].dst, it[0].dst });
+			}
+
+			return 2;
+		}
+
+		// mov r, r => nothing
+		inline size_t peephole_self_move(std::vector<x86::Instruction>&, Iter it, Iter) {
+			using namespace x86;
+
+			if (it[0].op != Opcode::Mov or not is_reg(it[0].dst) or it[0].dst != it[0].src) {
+				return 0;
+			}
+
+			return 1;
+		}
+
+		// mov r, x; ... (nothing reads r)
+		inline size_t peephole_dead_move(std::vector<x86::Instruction>&, Iter it, Iter end) {
+			using namespace x86;
+
+			if (it[0].op != Opcode::Mov or not is_reg(it[0].dst) or not is_dead(it + 1, end, it[0].dst.reg)) {
+				return 0;
+			}
+
+			return 1;
+		}
+
+		// mov a, x; mov b, a => mov b, x (when `a` is dead afterwards)
+		inline size_t peephole_move_chain(std::vector<x86::Instruction>& out, Iter it, Iter end) {
+			using namespace x86;
+
+			if (end - it < 2 or it[0].op != Opcode::Mov or it[1].op != Opcode::Mov) {
+				return 0;
+			}
+
+			if (not is_reg(it[0].dst) or it[1].src != it[0].dst or not is_dead(it + 2, end, it[0].dst.reg)) {
+				return 0;
+			}
+
+			out.push_back({ Opcode::Mov, it[1].dst, it[0].src });
+
+			return 2;
+		}
+
+		// mov r, imm; push r => push imm
+		inline size_t peephole_push_immediate(std::vector<x86::Instruction>& out, Iter it, Iter end) {
+			using namespace x86;
+
+			if (end - it < 2 or it[0].op != Opcode::Mov or it[1].op != Opcode::Push) {
+				return 0;
+			}
+
+			if (not is_imm32(it[0].src) or it[1].dst != it[0].dst or not is_dead(it + 2, end, it[0].dst.reg)) {
+				return 0;
+			}
+
+			out.push_back({ Opcode::Push, it[0].src, {} });
+
+			return 2;
+		}
+
+		// mov r, imm; ...; add x, r => ...; add x, imm
+		// Also applies to `sub`, `imul` and `cmp`. The instructions in
+		// between must leave `r` alone.
+		inline size_t peephole_fold_immediate(std::vector<x86::Instruction>& out, Iter it, Iter end) {
+			using namespace x86;
+
+			if (it[0].op != Opcode::Mov or not is_reg(it[0].dst) or not is_imm32(it[0].src)) {
+				return 0;
+			}
+
+			Register r = it[0].dst.reg;
+
+			for (size_t i = 1; i != PEEPHOLE_LOOKAHEAD and it + i != end; ++i) {
+				const Instruction& instr = it[i];
+
+				bool foldable = eq_any(instr.op, Opcode::Add, Opcode::Sub, Opcode::Imul, Opcode::Cmp);
+
+				if (foldable and is_reg(instr.src, r) and not is_reg(instr.dst, r)) {
+					if (not is_dead(it + i + 1, end, r)) {
+						return 0;
+					}
+
+					out.insert(out.end(), it + 1, it + i);
+					out.push_back({ instr.op, instr.dst, it[0].src });
+
+					return i + 1;
+				}
+
+				if (touches(instr, r)) {
+					return 0;
+				}
+			}
+
+			return 0;
+		}
+
+		// mov c, imm; ...; cmp c, k; cmove a, b => ...; mov a, b (or nothing)
+		// A choice on a constant condition is decided at compile time.
+		inline size_t peephole_fuse_cmove(std::vector<x86::Instruction>& out, Iter it, Iter end) {
+			using namespace x86;
+
+			if (it[0].op != Opcode::Mov or not is_reg(it[0].dst) or not is_imm(it[0].src)) {
+				return 0;
+			}
+
+			Register c = it[0].dst.reg;
+
+			for (size_t i = 1; i != PEEPHOLE_LOOKAHEAD and end - (it + i) >= 2; ++i) {
+				const Instruction& cmp = it[i];
+				const Instruction& cmove = it[i + 1];
+
+				if (cmp.op == Opcode::Cmp and is_reg(cmp.dst, c) and is_imm(cmp.src) and cmove.op == Opcode::Cmove) {
+					if (is_reg(cmove.dst, c) or is_reg(cmove.src, c)) {
+						return 0;
+					}
+
+					if (not is_dead(it + i + 2, end, c) or not flags_dead(it + i + 2, end)) {
+						return 0;
+					}
+
+					out.insert(out.end(), it + 1, it + i);
+
+					if (it[0].src.imm == cmp.src.imm) {
+						out.push_back({ Opcode::Mov, cmove.dst, cmove.src });
+					}
+
+					return i + 2;
+				}
+
+				if (touches(cmp, c)) {
+					return 0;
+				}
+			}
+
+			return 0;
+		}
+
+		constexpr std::array PEEPHOLE_RULES {
+			PeepholeRule { "push/pop cancellation", peephole_push_pop },
+			PeepholeRule { "self move", peephole_self_move },
+			PeepholeRule { "cmp/cmove fusion", peephole_fuse_cmove },
+			PeepholeRule { "immediate folding", peephole_fold_immediate },
+			PeepholeRule { "push immediate", peephole_push_immediate },
+			PeepholeRule { "move chain", peephole_move_chain },
+			PeepholeRule { "dead move", peephole_dead_move },
+		};
+	}  // namespace detail
+
+	// How many instructions each rule removed is added to `counters` when
+	// one is given.
+	inline x86::Program peephole(x86::Program&& program, PassCounters* counters = nullptr) {
+		DECK_LOG(Priority::Okay);
+
+		std::array<size_t, detail::PEEPHOLE_RULES.size()> removed {};
+
+		std::vector<x86::Instruction> out;
+		bool changed = true;
+
+		// Rewrites can expose new opportunities so we keep sweeping until
+		// nothing changes.
+		while (changed) {
+			changed = false;
+
+			const x86::Instruction* it = program.instructions.data();
+			const x86::Instruction* end = it + program.instructions.size();
+
+			out.clear();
+			out.reserve(program.instructions.size());
+
+			while (it != end) {
+				size_t consumed = 0;
+
+				for (size_t i = 0; i != detail::PEEPHOLE_RULES.size(); ++i) {
+					size_t before = out.size();
+
+					if ((consumed = detail::PEEPHOLE_RULES[i].fn(out, it, end)) != 0) {
+						removed[i] += consumed - (out.size() - before);
+						break;
+					}
+				}
+
+				if (consumed == 0) {
+					out.push_back(*it++);
+					continue;
+				}
+
+				it += consumed;
+				changed = true;
+			}
+
+			program.instructions.swap(out);
+		}
+
+		for (size_t i = 0; i != detail::PEEPHOLE_RULES.size(); ++i) {
+			DECK_LOG(Priority::Info, detail::PEEPHOLE_RULES[i].name, ": removed ", removed[i], " instructions");
+
+			if (counters) {
+				counters->emplace_back(detail::PEEPHOLE_RULES[i].name, removed[i]);
+			}
+		}
+
+		return program;
+	}
+}  // namespace deck::passes
+
+#endif
@@ -26,11 +26,13 @@ namespace deck::passes {
 		}
 	}
 
-	inline void printer_impl(Tree& tree, Tree::iterator current, Tree::iterator& it, size_t spaces = 0) {
-		auto [str, kind] = *current;
+	// Nesting is tracked in `depth` rather than by recursing into blocks
+	// so the printer can share a traversal with other passes that only
+	// read the tree.
+	inline void print_symbol(std::ostream& os, Symbol sym, size_t& depth) {
+		auto [str, kind, id] = sym;
 
 		constexpr std::array colours { DECK_BLUE, DECK_YELLOW };
-		const auto colour = colours[spaces % colours.size()];
 
 		switch (kind) {
 			case SymbolKind::String:  // Cases with associated string.
@@ -41,28 +43,30 @@ namespace deck::passes {
 			case SymbolKind::Declare:
 			case SymbolKind::Label:
 			case SymbolKind::Address: {
-				detail::indent(std::cerr, spaces);
-				println(std::cerr, colour, kind, " ", str, DECK_RESET);
+				detail::indent(os, depth);
+				println(os, colours[depth % colours.size()], kind, " ", str, DECK_RESET);
 			} break;
 
 			case SymbolKind::Header:  // No string data.
 			case SymbolKind::Footer: {
-				detail::indent(std::cerr, spaces);
-				println(std::cerr, colour, kind, DECK_RESET);
+				detail::indent(os, depth);
+				println(os, colours[depth % colours.size()], kind, DECK_RESET);
 			} break;
 
 			case SymbolKind::Quote:  // Blocks
 			case SymbolKind::Frame: {
-				detail::indent(std::cerr, spaces);
-				println(std::cerr, colour, kind, DECK_RESET);
+				detail::indent(os, depth);
+				println(os, colours[depth % colours.size()], kind, DECK_RESET);
 
-				it = visit_block(printer_impl, tree, it, spaces + 1);
-
-				detail::indent(std::cerr, spaces);
-				println(std::cerr, colour, "End", DECK_RESET);
+				++depth;
 			} break;
 
-			case SymbolKind::End: break;
+			case SymbolKind::End: {
+				--depth;
+
+				detail::indent(os, depth);
+				println(os, colours[depth % colours.size()], "End", DECK_RESET);
+			} break;
 
 			default: {
 				DECK_LOG(Priority::Warn, "unhandled symbol: `", kind, "`");
@@ -73,7 +77,12 @@ namespace deck::passes {
 	inline Tree printer(Tree&& tree) {
 		DECK_LOG(Priority::Okay);
 
-		pass(printer_impl, tree, 0ul);
+		size_t depth = 0;
+
+		for (Symbol sym: tree.symbols) {
+			print_symbol(std::cerr, sym, depth);
+		}
+
 		return tree;
 	}
 }  // namespace deck::passes
@@ -2,7 +2,7 @@
 #define DECK_PASS_X86_64_HPP
 
 /*
-	Emit x86-64 assembly
+	Lower the tree to x86-64 instructions.
 */
 
 #include <cstddef>
@@ -11,126 +11,359 @@
 #include <utility>
 #include <iostream>
 
+#include <algorithm>
 #include <array>
-#include <unordered_map>
+#include <vector>
 #include <string_view>
 #include <string>
-
-#include <fmt/core.h>
+#include <unordered_set>
 
 #include <deck/deck.hpp>
+#include <deck/x86.hpp>
+#include <deck/passes/effects.hpp>
 
 namespace deck::passes {
+	struct X86Options {
+		bool call_ret = false;  // Use `call` and `ret` where possible.
+		bool jit = false;       // Jump to `__exit` at the end instead of exiting.
+	};
+
 	namespace detail {
+		// Registers available for caching stack slots. `rax` must come first
+		// since it holds the top of the stack in the canonical state.
+		constexpr std::array CACHE_REGISTERS {
+			x86::Register::Rax,
+			x86::Register::Rbx,
+			x86::Register::Rcx,
+			x86::Register::Rdx,
+			x86::Register::Rsi,
+		};
+
+		// Tracks which of the top stack slots currently live in registers.
+		// `slots.back()` holds the top of the stack and everything below
+		// `slots.front()` lives in memory in the usual order.
+		//
+		// Code at labels, calls and block boundaries expects the canonical
+		// state where only the top of the stack is cached in `rax`. Between
+		// those points we only touch memory when we run out of registers or
+		// need an operand that was spilled.
+		struct StackCache {
+			std::vector<x86::Register> slots { x86::Register::Rax };
+
+			bool is_cached(x86::Register r) const {
+				return std::find(slots.begin(), slots.end(), r) != slots.end();
+			}
+
+			// Spill the bottom-most cached slot. Slots are spilled from the
+			// bottom up so memory stays in stack order.
+			void spill(x86::Program& out) {
+				out.emit(x86::Opcode::Push, x86::reg(slots.front()));
+				slots.erase(slots.begin());
+			}
+
+			// Find a register that isn't caching any slot, spilling if all
+			// of them are in use.
+			x86::Register alloc(x86::Program& out) {
+				for (x86::Register r: CACHE_REGISTERS) {
+					if (not is_cached(r)) {
+						return r;
+					}
+				}
+
+				x86::Register r = slots.front();
+				spill(out);
+
+				return r;
+			}
+
+			// Cache a new top of stack.
+			x86::Register push(x86::Program& out) {
+				x86::Register r = alloc(out);
+				slots.push_back(r);
+
+				return r;
+			}
+
+			// Make sure at least `n` of the top slots are in registers by
+			// reloading them from memory.
+			void ensure(x86::Program& out, size_t n) {
+				DECK_ASSERT(n <= CACHE_REGISTERS.size());
+
+				while (slots.size() < n) {
+					x86::Register r = alloc(out);
+					out.emit(x86::Opcode::Pop, x86::reg(r));
+					slots.insert(slots.begin(), r);
+				}
+			}
+
+			// Register holding the `n`th slot from the top.
+			x86::Register at(size_t n) const {
+				return slots[slots.size() - n - 1];
+			}
+
+			// Replace the top `n` slots with a single slot held in `r`.
+			void collapse(size_t n, x86::Register r) {
+				slots.resize(slots.size() - n + 1);
+				slots.back() = r;
+			}
+
+			// Drop the top of the stack.
+			void drop(x86::Program& out) {
+				if (slots.empty()) {
+					out.emit(x86::Opcode::Add, x86::reg(x86::Register::Rsp), x86::imm(8));
+					return;
+				}
+
+				slots.pop_back();
+			}
+
+			// Spill everything but the top of the stack which ends up in `rax`.
+			void canonicalize(x86::Program& out) {
+				if (slots.empty()) {
+					out.emit(x86::Opcode::Pop, x86::reg(x86::Register::Rax));
+					reset();
+
+					return;
+				}
+
+				while (slots.size() > 1) {
+					spill(out);
+				}
+
+				if (slots.back() != x86::Register::Rax) {
+					out.emit(x86::Opcode::Mov, x86::reg(x86::Register::Rax), x86::reg(slots.back()));
+				}
+
+				reset();
+			}
+
+			// Assume the canonical state (i.e. after a label).
+			void reset() {
+				slots.assign({ x86::Register::Rax });
+			}
+		};
+
+		// The symbol table is indexed by interned ID. Primitives are always
+		// defined.
+		//
+		// In `--call-ret` mode, labels known to return to their caller are
+		// called with `call` and return with `ret` so the CPU's return
+		// stack buffer can predict them. Such labels get a second entry
+		// point in `native_labels` which moves the return address pushed
+		// by `call` to the top of the stack, where the body expects its
+		// continuation. Everything else keeps using continuation jumps.
 		struct X86Env {
-			std::unordered_set<std::string> symbol_table;
+			std::vector<bool> symbol_table;
+			std::vector<size_t> symbol_labels;
 			size_t id = 0;
 
-			X86Env(): symbol_table { "+", "-", "*", "/", "%", "?", ".", "pop", "dup", "#", "clear" }, id { 0 } {}
-		};
+			std::vector<size_t> native_labels;
+			std::unordered_set<size_t> native_returns;  // Indices of returning `.`.
+
+			const Interner& interner;
+			X86Options options;
+
+			x86::Program program;
+			StackCache cache;
+
+			X86Env(const Interner& interner_, X86Options options_):
+					symbol_table(interner_.size(), false),
+					symbol_labels(interner_.size(), SYMBOL_NONE),
+					id { 0 },
+					native_labels(interner_.size(), SYMBOL_NONE),
+					interner(interner_),
+					options(options_) {
+				std::fill_n(symbol_table.begin(), PRIMITIVE_COUNT, true);
+			}
+
+			bool is_defined(size_t sym) const {
+				return symbol_table[sym];
+			}
+
+			// Returns false if the symbol was already defined.
+			bool define(size_t sym) {
+				if (symbol_table[sym]) {
+					return false;
+				}
+
+				symbol_table[sym] = true;
+				return true;
+			}
+
+			// Label for a user defined symbol, created on first use.
+			size_t label_of(size_t sym) {
+				if (symbol_labels[sym] == SYMBOL_NONE) {
+					symbol_labels[sym] = program.make_label(std::string { interner.str(sym) });
+				}
 
+				return symbol_labels[sym];
+			}
+
+			// Compiler generated label i.e. `__quote_0`.
+			size_t make_label(std::string_view prefix, size_t n) {
+				return program.make_label(std::string { prefix } + std::to_string(n));
+			}
+		};
 	}  // namespace detail
 
-	template <typename... Ts>
-	inline decltype(auto) emit(Ts&&... args) {
-		println(std::cout, std::forward<Ts>(args)...);
+	inline void emit(detail::X86Env& env, x86::Opcode op, x86::Operand dst = {}, x86::Operand src = {}) {
+		env.program.emit(op, dst, src);
 	}
 
-	inline void x86_64_primitive(std::string_view str, detail::X86Env& env) {
-		using namespace std::literals;
+	// Emit a binary operation on the top two slots. The result replaces
+	// both and, like the runtime builtins, is computed as `top op second`.
+	inline void x86_64_binary(detail::X86Env& env, x86::Opcode op) {
+		env.cache.ensure(env.program, 2);
 
-		// Arithmetic
-		if (str == "+"sv) {
-			emit("  pop rbx");
-			emit("  add rax, rbx");
-		}
+		x86::Register top = env.cache.at(0);
+		x86::Register second = env.cache.at(1);
 
-		else if (str == "-"sv) {
-			emit("  pop rbx");
-			emit("  sub rax, rbx");
-		}
+		emit(env, op, x86::reg(top), x86::reg(second));
+		env.cache.collapse(2, top);
+	}
 
-		else if (str == "*"sv) {
-			emit("  pop rbx");
-			emit("  imul rax, rbx");
-		}
+	// Cache a new top of stack holding `value`.
+	inline void x86_64_push(detail::X86Env& env, x86::Operand value) {
+		x86::Register r = env.cache.push(env.program);
+		emit(env, x86::Opcode::Mov, x86::reg(r), value);
+	}
 
-		else if (str == "/"sv) {
-			emit("  pop rbx");
-			emit("  div rbx");
-		}
+	inline void x86_64_primitive(Symbol sym, detail::X86Env& env) {
+		using namespace x86;
 
-		else if (str == "%"sv) {
-			emit("  pop rbx");
-			emit("  div rbx");
-			emit("  mov rax, rdx");
-		}
+		// Just call the function if it exists and isn't a primitive.
+		if (not is_primitive(sym.id) and env.native_labels[sym.id] != SYMBOL_NONE) {
+			env.cache.canonicalize(env.program);
 
-		// Choice
-		else if (str == "?"sv) {
-			// False value is in rax.
-			emit("  pop rbx");  // True value
-			emit("  pop rcx");  // Condition value
-			emit("  cmp rcx, 1");
-			emit("  cmove rax, rbx");
-		}
+			emit(env, Opcode::Push, reg(Register::Rax));
+			emit(env, Opcode::Call, label(env.native_labels[sym.id]));
 
-		else if (str == "."sv) {
-			emit("  mov rbx, rax");
-			emit("  pop rax");
-			emit("  jmp rbx");
+			return;
 		}
 
-		// Stack manipulation
-		else if (str == "pop"sv) {
-			emit("  pop rax");
-		}
+		if (not is_primitive(sym.id)) {
+			size_t return_addr = env.make_label("__return_addr_", env.id++);
 
-		else if (str == "dup"sv) {
-			emit("  push rax");
-		}
+			env.cache.canonicalize(env.program);
 
-		else if (str == "#"sv) {
-			emit("  push rax");
-			emit("  mov rax, rbp");
-			emit("  sub rbx, rsp");
-			emit("  shr rax, 3");  // div 8
-		}
+			emit(env, Opcode::Push, reg(Register::Rax));
+			emit(env, Opcode::Mov, reg(Register::Rax), label(return_addr));
+			emit(env, Opcode::Jmp, label(env.label_of(sym.id)));
+			emit(env, Opcode::Label, label(return_addr));
 
-		else if (str == "clear"sv) {
-			emit("  mov rsp, rbp");
+			return;
 		}
 
-		// Just call the function if it exists and isn't a primitive.
-		else {
-			size_t return_addr_id = env.id++;
+		switch (static_cast<Primitive>(sym.id)) {
+			// Arithmetic
+			case Primitive::Add: x86_64_binary(env, Opcode::Add); break;
+			case Primitive::Sub: x86_64_binary(env, Opcode::Sub); break;
+			case Primitive::Mul: x86_64_binary(env, Opcode::Imul); break;
+
+			// `div` is tied to `rax` and `rdx` so we go through the canonical
+			// state rather than trying to shuffle registers around it.
+			case Primitive::Div: {
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Pop, reg(Register::Rbx));
+				emit(env, Opcode::Xor, reg(Register::Rdx), reg(Register::Rdx));
+				emit(env, Opcode::Div, reg(Register::Rbx));
+			} break;
 
-			emit("  push rax");
-			emit("  mov rax, __return_addr_", return_addr_id);
-			emit("  jmp ", str);
-			emit("__return_addr_", return_addr_id, ":");
+			case Primitive::Mod: {
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Pop, reg(Register::Rbx));
+				emit(env, Opcode::Xor, reg(Register::Rdx), reg(Register::Rdx));
+				emit(env, Opcode::Div, reg(Register::Rbx));
+				emit(env, Opcode::Mov, reg(Register::Rax), reg(Register::Rdx));
+			} break;
+
+			// Choice
+			case Primitive::Choose: {
+				env.cache.ensure(env.program, 3);
+
+				Register f = env.cache.at(0);  // False value
+				Register t = env.cache.at(1);  // True value
+				Register cond = env.cache.at(2);
+
+				emit(env, Opcode::Cmp, reg(cond), imm(1));
+				emit(env, Opcode::Cmove, reg(f), reg(t));
+
+				env.cache.collapse(3, f);
+			} break;
+
+			case Primitive::Call: {
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Mov, reg(Register::Rbx), reg(Register::Rax));
+				emit(env, Opcode::Pop, reg(Register::Rax));
+				emit(env, Opcode::Jmp, reg(Register::Rbx));
+			} break;
+
+			// Stack manipulation
+			case Primitive::Pop: {
+				env.cache.drop(env.program);
+			} break;
+
+			case Primitive::Dup: {
+				env.cache.ensure(env.program, 1);
+				x86_64_push(env, reg(env.cache.at(0)));
+			} break;
+
+			// Anything that inspects the stack pointer needs every slot in
+			// memory.
+			case Primitive::Count: {
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Push, reg(Register::Rax));
+				emit(env, Opcode::Mov, reg(Register::Rax), reg(Register::Rbp));
+				emit(env, Opcode::Sub, reg(Register::Rax), reg(Register::Rsp));
+				emit(env, Opcode::Shr, reg(Register::Rax), imm(3));  // div 8
+			} break;
+
+			case Primitive::Clear: {
+				env.cache.canonicalize(env.program);
+				emit(env, Opcode::Mov, reg(Register::Rsp), reg(Register::Rbp));
+			} break;
 		}
 	}
 
 	inline void x86_64_impl(Tree& tree, Tree::iterator current, Tree::iterator& it, detail::X86Env& env) {
-		auto [str, kind] = *current;
+		using namespace x86;
+
+		auto [str, kind, id] = *current;
 
 		switch (kind) {
 			// ELF Metadata
 			case SymbolKind::Header: {
-				// TODO: Setup both main and return stacks.
-				// Also make sure to take into account that the first push
-				// will push garbage to the stack so we want to start 1 word
-				// below the true starting point.
+				// TODO: Setup a separate return stack.
+
+				emit(env, Opcode::Label, label(env.program.make_label("_start")));
+				emit(env, Opcode::Mov, reg(Register::Rax), imm(0));
 
-				emit("section .text");
-				emit("global _start");
-				emit("_start:");
-				emit("  mov rax, 0");
+				// Base for `#`, skipping the slot the garbage in `rax` is
+				// pushed to.
+				emit(env, Opcode::Mov, reg(Register::Rbp), reg(Register::Rsp));
+				emit(env, Opcode::Sub, reg(Register::Rbp), imm(8));
+
+				env.cache.reset();
 			} break;
 
+			// Exit with the top of the stack as the status. When running
+			// in-process, the JIT's trampoline provides `__exit` which
+			// hands the status back to the host.
 			case SymbolKind::Footer: {
-				// TODO: Emit exit syscall
+				env.cache.canonicalize(env.program);
+
+				if (env.options.jit) {
+					emit(env, Opcode::Jmp, label(env.program.make_label("__exit")));
+					break;
+				}
+
+				emit(env, Opcode::Mov, reg(Register::Rdi), reg(Register::Rax));
+				emit(env, Opcode::Mov, reg(Register::Rax), imm(60));  // exit
+				emit(env, Opcode::Syscall);
 			} break;
 
 			// Literals
@@ -139,35 +372,58 @@ namespace deck::passes {
 			} break;
 
 			case SymbolKind::Integer: {
-				emit("  push rax");
-				emit("  mov rax, ", str);
+				std::optional<uint64_t> value = parse_integer(str);
+
+				if (not value) {
+					fatal("`", str, "` is not a valid integer");
+				}
+
+				x86_64_push(env, imm(*value));
 			} break;
 
 			// Function call
 			case SymbolKind::Identifier: {
-				if (auto it = env.symbol_table.find(str); it == env.symbol_table.end()) {
+				if (not env.is_defined(id)) {
 					fatal("`", str, "` is not defined");
 				}
 
-				x86_64_primitive(str, env);
+				// Return to a caller that used `call`. Behaves the same as a
+				// plain `.` even if we got here some other way.
+				if (env.native_returns.count(current - tree.begin())) {
+					env.cache.canonicalize(env.program);
+
+					emit(env, Opcode::Mov, reg(Register::Rbx), reg(Register::Rax));
+					emit(env, Opcode::Pop, reg(Register::Rax));
+					emit(env, Opcode::Push, reg(Register::Rbx));
+					emit(env, Opcode::Ret);
+
+					break;
+				}
+
+				x86_64_primitive(*current, env);
 			} break;
 
 			// Definition and address
 			case SymbolKind::Declare: {
 				// TODO: Emit an extern directive. Should we move all of these
 				// to the top of the emitted assembly?
-
-				if (auto [it, succ] = env.symbol_table.emplace(str); not succ) {
-					fatal("`", str, "` is declared already");
-				}
 			} break;
 
 			case SymbolKind::Label: {
-				if (auto [it, succ] = env.symbol_table.emplace(str); not succ) {
-					fatal("`", str, "` is declared already");
-				}
+				env.cache.canonicalize(env.program);
+
+				// Entry point for `call` which falling through skips over.
+				if (size_t native = env.native_labels[id]; native != SYMBOL_NONE) {
+					const auto& instrs = env.program.instructions;
 
-				emit(str, ":");
+					if (instrs.empty() or eq_none(instrs.back().op, Opcode::Jmp, Opcode::Ret)) {
+						emit(env, Opcode::Jmp, label(env.label_of(id)));
+					}
+
+					emit(env, Opcode::Label, label(native));
+					emit(env, Opcode::Pop, reg(Register::Rax));
+				}
+				emit(env, Opcode::Label, label(env.label_of(id)));
 			} break;
 
 			case SymbolKind::Address: {
@@ -175,39 +431,46 @@ namespace deck::passes {
 				// We might also check if a primitive's address has been taken
 				// here and emit a wrapper function for it so it can be addressed.
 
-				if (auto it = env.symbol_table.find(str); it == env.symbol_table.end()) {
+				if (not env.is_defined(id)) {
 					fatal("`", str, "` is not defined");
 				}
 
-				emit("  push rax");
-				emit("  mov rax, ", str);
+				x86_64_push(env, label(env.label_of(id)));
 			} break;
 
 			// Anonymous function
 			case SymbolKind::Quote: {
 				size_t quote_id = env.id++;
 
-				emit("  jmp __quote_end_", quote_id);
-				emit("__quote_", quote_id, ":");
+				size_t quote = env.make_label("__quote_", quote_id);
+				size_t quote_end = env.make_label("__quote_end_", quote_id);
+
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Jmp, label(quote_end));
+				emit(env, Opcode::Label, label(quote));
 
 				it = visit_block(x86_64_impl, tree, it, env);
+				env.cache.canonicalize(env.program);
 
-				emit("__quote_end_", quote_id, ":");
+				emit(env, Opcode::Label, label(quote_end));
 
-				emit("  push rax");
-				emit("  mov rax, __quote_", quote_id);
+				x86_64_push(env, label(quote));
 			} break;
 
 			// Stack frames
 			case SymbolKind::Frame: {
-				emit("  push rax");
-				emit("  mov rax, rbp");
-				emit("  mov rbp, rsp");
+				env.cache.canonicalize(env.program);
+
+				emit(env, Opcode::Push, reg(Register::Rax));
+				emit(env, Opcode::Mov, reg(Register::Rax), reg(Register::Rbp));
+				emit(env, Opcode::Mov, reg(Register::Rbp), reg(Register::Rsp));
 
 				it = visit_block(x86_64_impl, tree, it, env);
+				env.cache.canonicalize(env.program);
 
-				emit("  mov rbp, rax");
-				emit("  pop rax");
+				emit(env, Opcode::Mov, reg(Register::Rbp), reg(Register::Rax));
+				emit(env, Opcode::Pop, reg(Register::Rax));
 			} break;
 
 			case SymbolKind::End: break;
@@ -218,17 +481,37 @@ namespace deck::passes {
 		}
 	}
 
-	inline Tree x86_64(Tree&& tree) {
+	inline x86::Program x86_64(Tree&& tree, X86Options options = {}) {
 		DECK_LOG(Priority::Okay);
 
-		detail::X86Env env;
-		pass(x86_64_impl, tree, env);
+		detail::X86Env env { tree.interner, options };
 
-		for (const std::string& str: env.symbol_table) {
-			DECK_LOG(Priority::Info, str);
+		// Definitions are collected up front so labels can be referred to
+		// before they appear.
+		for (size_t i = 0; i != tree.size(); ++i) {
+			Symbol sym = tree.symbols[i];
+
+			if (eq_none(sym.kind, SymbolKind::Declare, SymbolKind::Label)) {
+				continue;
+			}
+
+			if (not env.define(sym.id)) {
+				fatal("`", sym.str, "` is declared already");
+			}
+
+			if (not options.call_ret or sym.kind != SymbolKind::Label) {
+				continue;
+			}
+
+			if (auto ret = detail::returning_call(tree, i)) {
+				env.native_labels[sym.id] = env.program.make_label("__native_" + std::string { sym.str });
+				env.native_returns.insert(*ret);
+			}
 		}
 
-		return tree;
+		pass(x86_64_impl, tree, env);
+
+		return std::move(env.program);
 	}
 }  // namespace deck::passes
 
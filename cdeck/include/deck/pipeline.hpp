@@ -0,0 +1,180 @@
+#ifndef DECK_PIPELINE_HPP
+#define DECK_PIPELINE_HPP
+
+/*
+	Named tree passes which can be put together into a pipeline on the
+	command line with `-p fold,effects,inline,print`. Diagnostic passes
+	aren't part of the default pipeline so they cost nothing unless asked
+	for.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <deck/deck.hpp>
+#include <deck/manager.hpp>
+
+#include <deck/passes/dumper.hpp>
+#include <deck/passes/printer.hpp>
+#include <deck/passes/fold.hpp>
+#include <deck/passes/effects.hpp>
+#include <deck/passes/inline.hpp>
+
+namespace deck {
+	// Observers only read the tree and write to stderr.
+#define TREE_PASSES \
+	X(Fold, "fold", false) \
+	X(Effects, "effects", false) \
+	X(Inline, "inline", false) \
+	X(Dump, "dump", true) \
+	X(Print, "print", true)
+
+#define X(a, b, c) a,
+	enum class TreePass : size_t {
+		TREE_PASSES
+	};
+#undef X
+
+	namespace detail {
+#define X(a, b, c) b,
+		constexpr const char* TREE_PASS_TO_STR[] = { TREE_PASSES };
+#undef X
+
+#define X(a, b, c) c,
+		constexpr bool TREE_PASS_OBSERVES[] = { TREE_PASSES };
+#undef X
+	}  // namespace detail
+
+	constexpr const char* tree_pass_to_str(TreePass x) {
+		return detail::TREE_PASS_TO_STR[static_cast<size_t>(x)];
+	}
+
+	constexpr bool is_observer(TreePass x) {
+		return detail::TREE_PASS_OBSERVES[static_cast<size_t>(x)];
+	}
+
+	inline std::ostream& operator<<(std::ostream& os, TreePass x) {
+		return print(os, tree_pass_to_str(x));
+	}
+
+	constexpr std::string_view DEFAULT_PIPELINE = "fold,effects,inline";
+
+	// Parse a comma separated list of pass names. Names can repeat.
+	inline std::vector<TreePass> parse_pipeline(std::string_view spec) {
+		std::vector<TreePass> pipeline;
+
+		while (not spec.empty()) {
+			size_t comma = spec.find(',');
+			std::string_view name = spec.substr(0, comma);
+
+			spec = comma == std::string_view::npos ? std::string_view {} : spec.substr(comma + 1);
+
+			if (name.empty()) {
+				continue;
+			}
+
+			auto it = std::find(std::begin(detail::TREE_PASS_TO_STR), std::end(detail::TREE_PASS_TO_STR), name);
+
+			if (it == std::end(detail::TREE_PASS_TO_STR)) {
+				std::string names;
+
+				for (const char* str: detail::TREE_PASS_TO_STR) {
+					names += names.empty() ? "" : ", ";
+					names += str;
+				}
+
+				fatal("unknown pass `", name, "`, expected one of: ", names);
+			}
+
+			pipeline.push_back(static_cast<TreePass>(it - std::begin(detail::TREE_PASS_TO_STR)));
+		}
+
+		return pipeline;
+	}
+
+	// Runs a group of adjacent observers in one traversal. Each writes to
+	// its own buffer and the buffers are flushed in pipeline order so the
+	// output is the same as running them one after another.
+	inline Tree observe(Tree&& tree, const std::vector<TreePass>& group) {
+		DECK_LOG(Priority::Okay);
+
+		std::vector<std::ostringstream> out(group.size());
+		std::vector<size_t> depth(group.size(), 0);
+
+		for (Symbol sym: tree.symbols) {
+			for (size_t i = 0; i != group.size(); ++i) {
+				switch (group[i]) {
+					case TreePass::Dump: passes::dump_symbol(out[i], sym); break;
+					case TreePass::Print: passes::print_symbol(out[i], sym, depth[i]); break;
+					default: DECK_ASSERT(is_observer(group[i])); break;
+				}
+			}
+		}
+
+		for (const std::ostringstream& os: out) {
+			std::cerr << os.view();
+		}
+
+		return tree;
+	}
+
+	inline Tree run_pass(TreePass x, Tree&& tree) {
+		switch (x) {
+			case TreePass::Fold: return passes::fold(std::move(tree));
+			case TreePass::Effects: return passes::effects(std::move(tree));
+			case TreePass::Inline: return passes::inliner(std::move(tree));
+			case TreePass::Dump: return passes::dumper(std::move(tree));
+			case TreePass::Print: return passes::printer(std::move(tree));
+		}
+
+		return tree;
+	}
+
+	inline Tree run_pipeline(PassManager& pm, Tree&& tree, const std::vector<TreePass>& pipeline) {
+		for (size_t i = 0; i != pipeline.size();) {
+			if (not is_observer(pipeline[i])) {
+				tree = pm.run(tree_pass_to_str(pipeline[i]), [&] { return run_pass(pipeline[i], std::move(tree)); });
+				++i;
+
+				continue;
+			}
+
+			size_t end = i;
+
+			while (end != pipeline.size() and is_observer(pipeline[end])) {
+				++end;
+			}
+
+			if (end - i == 1) {
+				tree = pm.run(tree_pass_to_str(pipeline[i]), [&] { return run_pass(pipeline[i], std::move(tree)); });
+			}
+
+			else {
+				std::vector<TreePass> group { pipeline.begin() + i, pipeline.begin() + end };
+				std::string name;
+
+				for (TreePass x: group) {
+					name += name.empty() ? "" : "+";
+					name += tree_pass_to_str(x);
+				}
+
+				tree = pm.run(name, [&] { return observe(std::move(tree), group); });
+			}
+
+			i = end;
+		}
+
+		return tree;
+	}
+}  // namespace deck
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef DECK_X86_HPP
+#define DECK_X86_HPP
+
+/*
+	In-memory representation of the x86-64 instructions we emit.
+	The backend lowers the tree to this form so that later passes can
+	rewrite it before it is printed or encoded.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <utility>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <deck/deck.hpp>
+
+namespace deck::x86 {
+#define REGISTERS \
+	X(Rax, "rax") \
+	X(Rbx, "rbx") \
+	X(Rcx, "rcx") \
+	X(Rdx, "rdx") \
+	X(Rsi, "rsi") \
+	X(Rdi, "rdi") \
+	X(Rbp, "rbp") \
+	X(Rsp, "rsp") \
+	X(R8, "r8") \
+	X(R9, "r9") \
+	X(R10, "r10") \
+	X(R11, "r11") \
+	X(R12, "r12") \
+	X(R13, "r13") \
+	X(R14, "r14") \
+	X(R15, "r15")
+
+#define X(a, b) a,
+	enum class Register : size_t {
+		REGISTERS
+	};
+#undef X
+
+	namespace detail {
+#define X(a, b) b,
+		constexpr const char* REGISTER_TO_STR[] = { REGISTERS };
+#undef X
+	}  // namespace detail
+
+	constexpr const char* reg_to_str(Register x) {
+		return detail::REGISTER_TO_STR[static_cast<size_t>(x)];
+	}
+
+	inline std::ostream& operator<<(std::ostream& os, Register x) {
+		return print(os, reg_to_str(x));
+	}
+
+#define OPCODES \
+	X(Label, "label") \
+\
+	X(Mov, "mov") \
+	X(Push, "push") \
+	X(Pop, "pop") \
+\
+	X(Add, "add") \
+	X(Sub, "sub") \
+	X(Imul, "imul") \
+	X(Div, "div") \
+	X(Xor, "xor") \
+	X(Shr, "shr") \
+\
+	X(Cmp, "cmp") \
+	X(Cmove, "cmove") \
+\
+	X(Jmp, "jmp") \
+	X(Call, "call") \
+	X(Ret, "ret") \
+\
+	X(Syscall, "syscall")
+
+#define X(a, b) a,
+	enum class Opcode : size_t {
+		OPCODES
+	};
+#undef X
+
+	namespace detail {
+#define X(a, b) b,
+		constexpr const char* OPCODE_TO_STR[] = { OPCODES };
+#undef X
+	}  // namespace detail
+
+	constexpr const char* opcode_to_str(Opcode x) {
+		return detail::OPCODE_TO_STR[static_cast<size_t>(x)];
+	}
+
+	inline std::ostream& operator<<(std::ostream& os, Opcode x) {
+		return print(os, opcode_to_str(x));
+	}
+
+	enum class OperandKind {
+		None,
+		Reg,
+		Imm,
+		Label,
+	};
+
+	// Labels are indices into `Program::labels`.
+	struct Operand {
+		OperandKind kind = OperandKind::None;
+
+		Register reg = Register::Rax;
+		uint64_t imm = 0;
+		size_t label = 0;
+	};
+
+	constexpr Operand reg(Register x) {
+		return { OperandKind::Reg, x, 0, 0 };
+	}
+
+	constexpr Operand imm(uint64_t x) {
+		return { OperandKind::Imm, Register::Rax, x, 0 };
+	}
+
+	constexpr Operand label(size_t x) {
+		return { OperandKind::Label, Register::Rax, 0, x };
+	}
+
+	constexpr bool is_reg(Operand x, Register r) {
+		return x.kind == OperandKind::Reg and x.reg == r;
+	}
+
+	constexpr bool is_reg(Operand x) {
+		return x.kind == OperandKind::Reg;
+	}
+
+	constexpr bool is_imm(Operand x) {
+		return x.kind == OperandKind::Imm;
+	}
+
+	// True if the immediate survives being sign extended from 32 bits which
+	// is all most instructions can encode.
+	constexpr bool is_imm32(Operand x) {
+		auto value = static_cast<int64_t>(x.imm);
+
+		return is_imm(x) and value >= std::numeric_limits<int32_t>::min() and
+			value <= std::numeric_limits<int32_t>::max();
+	}
+
+	constexpr bool operator==(Operand lhs, Operand rhs) {
+		if (lhs.kind != rhs.kind) {
+			return false;
+		}
+
+		switch (lhs.kind) {
+			case OperandKind::Reg: return lhs.reg == rhs.reg;
+			case OperandKind::Imm: return lhs.imm == rhs.imm;
+			case OperandKind::Label: return lhs.label == rhs.label;
+			default: return true;
+		}
+	}
+
+	struct Instruction {
+		Opcode op;
+
+		Operand dst;
+		Operand src;
+	};
+
+	struct Program {
+		std::vector<Instruction> instructions;
+		std::vector<std::string> labels;
+
+		// Create a new label. Labels are only placed once they are emitted
+		// with `Opcode::Label`.
+		size_t make_label(std::string name) {
+			labels.push_back(std::move(name));
+			return labels.size() - 1;
+		}
+
+		void emit(Opcode op, Operand dst = {}, Operand src = {}) {
+			instructions.push_back({ op, dst, src });
+		}
+
+		std::string_view label_name(size_t x) const {
+			return labels[x];
+		}
+	};
+}  // namespace deck::x86
+
+#endif
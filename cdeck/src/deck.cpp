@@ -1,5 +1,4 @@
 #include <utility>
-#include <iterator>
 
 #include <string>
 #include <string_view>
@@ -11,35 +10,162 @@
 #include <cstdint>
 
 #include <deck/deck.hpp>
+#include <deck/manager.hpp>
+#include <deck/pipeline.hpp>
 
-#include <deck/passes/dumper.hpp>
-#include <deck/passes/printer.hpp>
 #include <deck/passes/x86-64.hpp>
+#include <deck/passes/peephole.hpp>
+#include <deck/passes/nasm.hpp>
+#include <deck/passes/elf.hpp>
+#include <deck/passes/jit.hpp>
+#include <deck/passes/bytecode.hpp>
+#include <deck/passes/interp.hpp>
 
 using namespace deck;
 
-int main(int, const char*[]) {
+int main(int argc, const char* argv[]) {
 	std::ios_base::sync_with_stdio(false);
 	std::cin.tie(nullptr);
 
-	std::noskipws(std::cin);
-	std::istream_iterator<char> it { std::cin }, end;
+	int status = 0;
 
-	std::string src { it, end };
+	PassManager pm;
+	bool json = false;
+	[[maybe_unused]] bool trace = false;
 
 	try {
+		passes::X86Options options;
+		bool assembly = false;
+		bool interpret = false;
+
+		const char* path = nullptr;
+		const char* output = "a.out";
+
+		std::string_view pipeline = DEFAULT_PIPELINE;
+
+		int first = 1;
+
+		// `deck run file.dk` compiles and runs in-process, exiting with
+		// the program's status.
+		if (argc > 1 and std::string_view { argv[1] } == "run") {
+			options.jit = true;
+			first = 2;
+		}
+
+		// `deck interp file.dk` does the same with the bytecode interpreter.
+		else if (argc > 1 and std::string_view { argv[1] } == "interp") {
+			interpret = true;
+			first = 2;
+		}
+
+		for (int i = first; i != argc; ++i) {
+			std::string_view arg = argv[i];
+
+			if (arg == "--call-ret") {
+				options.call_ret = true;
+			}
+
+			// Print NASM assembly to stdout instead of writing an executable.
+			else if (arg == "-S") {
+				assembly = true;
+			}
+
+			// Print how long each pass took to stderr once we're done.
+			else if (arg == "--time-passes") {
+				pm.timing = true;
+			}
+
+			else if (arg == "--time-passes=json") {
+				pm.timing = true;
+				json = true;
+			}
+
+			// Tree passes to run in order i.e. `-p fold,effects,print`.
+			else if (arg == "-p" or arg == "--passes") {
+				if (++i == argc) {
+					fatal("expected a list of passes after `", arg, "`");
+				}
+
+				pipeline = argv[i];
+			}
+
+			else if (arg.starts_with("--passes=")) {
+				pipeline = arg.substr(std::string_view { "--passes=" }.size());
+			}
+
+			// Dump the trace ring buffer once we're done.
+			else if (arg == "--trace") {
+#if not defined(DECK_TRACE_RING)
+				fatal("`--trace` needs a build with DECK_TRACE_RING enabled");
+#endif
+				trace = true;
+			}
+
+			else if (arg == "-o") {
+				if (++i == argc) {
+					fatal("expected a path after `-o`");
+				}
+
+				output = argv[i];
+			}
+
+			else if (arg.size() > 1 and arg.front() == '-') {
+				fatal("unknown option `", arg, "`");
+			}
+
+			else {
+				path = argv[i];
+			}
+		}
+
+		// Map the file given on the command line or fall back to stdin.
+		Source src = pm.run("read", [&] {
+			return path and std::string_view { path } != "-" ? map_source(path) : read_source(std::cin);
+		});
+
 		Tree tree;
 
-		tree = parse(std::move(src));
+		tree = pm.run("parse", [&] { return parse(std::move(src)); });
+		tree = run_pipeline(pm, std::move(tree), parse_pipeline(pipeline));
+
+		if (interpret) {
+			bc::Program bytecode = pm.run("bytecode", [&] { return passes::bytecode(std::move(tree)); });
+			status = static_cast<int>(pm.run("interp", [&] { return passes::interp(std::move(bytecode)); }));
+		}
 
-		tree = passes::dumper(std::move(tree));
-		tree = passes::printer(std::move(tree));
-		tree = passes::x86_64(std::move(tree));
+		else {
+			x86::Program program = pm.run("x86-64", [&] { return passes::x86_64(std::move(tree), options); });
+			program = pm.run("peephole", [&] { return passes::peephole(std::move(program), pm.sink()); });
+
+			if (options.jit) {
+				status = static_cast<int>(pm.run("jit", [&] { return passes::jit(std::move(program)); }));
+			}
+
+			else if (assembly) {
+				program = pm.run("nasm", [&] { return passes::nasm(std::move(program)); });
+			}
+
+			else {
+				program = pm.run("elf", [&] { return passes::elf(std::move(program), output); });
+			}
+		}
 	}
 
 	catch (const Exception& e) {
 		println(std::cerr, e.what());
+		status = 1;
+	}
+
+	// Passes that finished before an error are still reported.
+	if (pm.timing) {
+		json ? pm.report_json(std::cerr) : pm.report(std::cerr);
+	}
+
+#if defined(DECK_TRACE_RING)
+	if (trace) {
+		trace_ring.dump(std::cerr);
 	}
+#endif
 
-	return 0;
+	return status;
 }
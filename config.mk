@@ -12,6 +12,9 @@ LD=ld
 
 DBG=yes
 
+# Return from builtins with `ret` instead of an indirect jump.
+CALL_RET=no
+
 ifeq ($(DBG),no)
 	DECK_FLAGS=-O3 -felf64
 	DECK_LDFLAGS=-s -n --gc-sections $(LIB) $(LDFLAGS)
@@ -22,3 +25,7 @@ else
 $(error DBG should be either yes or no)
 endif
 
+ifeq ($(CALL_RET),yes)
+	DECK_FLAGS+=-DDECK_CALL_RET
+endif
+
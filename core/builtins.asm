@@ -10,7 +10,7 @@ ___mark: ; ( cont -> | mark )
 	add rbp, 8
 	mov [rbp], rax
 	mov r9, rsp
-	jmp r10
+	___ret
 
 d_5d: ; ]
 ___unmark: ; ( mark cont -> )
@@ -19,7 +19,7 @@ ___unmark: ; ( mark cont -> )
 	push qword [rbp]
 	sub rbp, 8
 	pop r9
-	jmp r10
+	___ret
 
 d_3f: ; ?
 ___choose: ; ( cond t f cont -> q )
@@ -33,7 +33,7 @@ ___choose: ; ( cond t f cont -> q )
 	cmp rcx, 1
 	cmove rax, rbx  ; Move the the `true` case to `rax` if `rcx` is `1`.
 	push rax
-	jmp r10
+	___ret
 
 
 ; STACK OPERATIONS
@@ -44,7 +44,7 @@ ___deque_push: ; ( cont -> )
 	pop rax
 	add rbp, 8
 	mov [rbp], rax
-	jmp r10
+	___ret
 
 d_7c3e: ; |>
 ___deque_pop: ; ( cont -> )
@@ -52,14 +52,14 @@ ___deque_pop: ; ( cont -> )
 	pop r10
 	push qword [rbp]
 	sub rbp, 8
-	jmp r10
+	___ret
 
 d_706f70: ; pop
 ___pop: ; ( val cont -> )
 ; Pop the top element of the stack.
 	pop r10
 	pop rax
-	jmp r10
+	___ret
 
 d_676574: ; get
 ___get: ; ( i cont -> x )
@@ -72,7 +72,7 @@ ___get: ; ( i cont -> x )
 	pop rax
 	shl rax, 3
 	push qword [rsp + rax]
-	jmp r10
+	___ret
 
 d_736574: ; set
 ___set: ; ( x i cont -> )
@@ -84,7 +84,7 @@ ___set: ; ( x i cont -> )
 	pop rbx ; x
 	shl rax, 3
 	mov qword [rsp + rax], rbx
-	jmp r10
+	___ret
 
 d_6d676574: ; mget
 ___mget: ; ( addr cont -> x )
@@ -93,7 +93,7 @@ ___mget: ; ( addr cont -> x )
 	pop r10
 	pop rax
 	push qword [rax]
-	jmp r10
+	___ret
 
 d_6d736574: ; mset
 ___mset: ; ( x addr cont -> )
@@ -102,7 +102,7 @@ ___mset: ; ( x addr cont -> )
 	pop rax ; addr
 	pop rbx ; x
 	mov [rax], rbx
-	jmp r10
+	___ret
 
 
 ; ARITHMETIC
@@ -113,7 +113,7 @@ ___add: ; ( a b cont -> q )
 	pop rbx
 	add rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_2d: ; -
 ___sub: ; ( a b cont -> q )
@@ -122,7 +122,7 @@ ___sub: ; ( a b cont -> q )
 	pop rbx
 	sub rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_2a: ; *
 ___mul: ; ( a b cont -> q )
@@ -131,7 +131,7 @@ ___mul: ; ( a b cont -> q )
 	pop rbx
 	imul rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_2f: ; /
 ___div: ; ( a b cont -> q )
@@ -143,7 +143,7 @@ ___div: ; ( a b cont -> q )
 	cqo
 	idiv rbx
 	push rax
-	jmp r10
+	___ret
 
 d_5c: ; %
 ___mod: ; ( a b cont -> q )
@@ -155,7 +155,7 @@ ___mod: ; ( a b cont -> q )
 	cqo
 	idiv rbx
 	push rdx
-	jmp r10
+	___ret
 
 d_3c3c: ; <<
 ___lsh: ; ( a b cont -> q )
@@ -164,7 +164,7 @@ ___lsh: ; ( a b cont -> q )
 	pop rcx
 	sal rax, cl
 	push rax
-	jmp r10
+	___ret
 
 d_3e3e: ; >>
 ___rsh: ; ( a b cont -> q )
@@ -173,14 +173,14 @@ ___rsh: ; ( a b cont -> q )
 	pop rcx
 	sar rax, cl
 	push rax
-	jmp r10
+	___ret
 
 d_6e6567: ; neg
 ___neg: ; ( x cont -> y )
 ; Make the top element negative (two's complement).
 	pop r10
 	neg qword [rsp]
-	jmp r10
+	___ret
 
 d_616273: ; abs
 ___abs: ; ( x cont -> y )
@@ -191,7 +191,7 @@ ___abs: ; ( x cont -> y )
 	neg rax
 	cmovl rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 
 ; BITWISE
@@ -203,7 +203,7 @@ ___and: ; ( a b cont -> q )
 	pop rbx
 	and rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_6f72: ; or
 ___or: ; ( a b cont -> q )
@@ -212,7 +212,7 @@ ___or: ; ( a b cont -> q )
 	pop rbx
 	or rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_786f72: ; xor
 ___xor: ; ( a b cont -> q )
@@ -221,13 +221,13 @@ ___xor: ; ( a b cont -> q )
 	pop rbx
 	xor rax, rbx
 	push rax
-	jmp r10
+	___ret
 
 d_6e6f74: ; not
 ___not: ; ( x cont -> q )
 	pop r10
 	not qword [rsp]
-	jmp r10
+	___ret
 
 
 ; COMPARISONS
@@ -243,7 +243,7 @@ ___eq: ; ( a b cont -> q )
 	sete al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
 d_213d: ; !=
 ___neq: ; ( a b cont -> q )
@@ -257,7 +257,7 @@ ___neq: ; ( a b cont -> q )
 	setne al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
 d_3c: ; <
 ___lt: ; ( a b cont -> q )
@@ -268,7 +268,7 @@ ___lt: ; ( a b cont -> q )
 	setl al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
 d_3c3d: ; <=
 ___lte: ; ( a b cont -> q )
@@ -279,7 +279,7 @@ ___lte: ; ( a b cont -> q )
 	setle al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
 d_3e: ; >
 ___gt: ; ( a b cont -> q )
@@ -290,7 +290,7 @@ ___gt: ; ( a b cont -> q )
 	setg al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
 d_3e3d: ; >=
 ___gte: ; ( a b cont -> q )
@@ -301,5 +301,5 @@ ___gte: ; ( a b cont -> q )
 	setge al
 	movzx rax, al
 	push rax
-	jmp r10
+	___ret
 
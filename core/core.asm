@@ -26,6 +26,18 @@
 	call %1
 %endmacro
 
+%macro ___ret 0 ; ( -> )
+; Return from a builtin to the continuation in `r10`.
+; Builtins are entered with `call` so when `DECK_CALL_RET` is
+; defined we return with `ret` which the CPU can predict.
+%ifdef DECK_CALL_RET
+	push r10
+	ret
+%else
+	jmp r10
+%endif
+%endmacro
+
 %macro ___go 0 ; ( addr -> )
 ; Jumps to the address on the top of the stack.
 	pop rax
@@ -72,7 +72,7 @@ io_read: ; ( cont -> x )
 	mov rdx, 8   ; count
 	syscall
 
-	jmp r10
+	___ret
 
 d_696f5f7772697465:
 io_write: ; ( x cont -> )
@@ -92,7 +92,7 @@ io_write: ; ( x cont -> )
 	syscall
 
 	add rsp, 8
-	jmp r10
+	___ret
 
 d_696f5f6865786c6e:
 io_hexln: ; ( x cont -> )
@@ -143,7 +143,7 @@ io_hexln: ; ( x cont -> )
 	syscall
 
 	mov rsp, r8
-	jmp r10
+	___ret
 
 
 d_696f5f696e746c6e:
@@ -183,7 +183,7 @@ io_intln: ; ( x cont -> )
 	syscall
 
 	mov rsp, r8
-	jmp r10
+	___ret
 
 
 